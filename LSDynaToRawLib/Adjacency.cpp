@@ -0,0 +1,296 @@
+// Adjacency.cpp : Node to element and element to element adjacency of a renumbered part, in compressed sparse row form.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "Adjacency.h"
+#include "MeshTools.h"
+#include "ColumnarFile.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <atomic>
+
+namespace d2r
+{
+
+namespace
+{
+	//Faces of a hexahedron, n1..n4 being the bottom and n5..n8 the top
+	const int HEX_FACES[6][4] = { { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 0, 1, 5, 4 }, { 1, 2, 6, 5 }, { 2, 3, 7, 6 }, { 3, 0, 4, 7 } };
+
+	//Faces of a tetrahedron written as n1, n2, n3, n4, n4, n4, n4, n4
+	const int TET_FACES[4][3] = { { 0, 1, 2 }, { 0, 1, 3 }, { 1, 2, 3 }, { 0, 2, 3 } };
+
+	//Rows per block of the parallel prefix sum and of the neighbor search
+	const size_t BLOCK = 4096;
+
+	//Facets of one element as sorted node positions
+	struct Facets
+	{
+		int count;
+		int size[6];
+		int nodes[6][4];
+
+		void Add(int const *p, int n)
+		{
+			int k = 0;
+			for (int a = 0; a < n; ++a)
+			{
+				bool seen = p[a] < 0;
+				for (int b = 0; b < k && !seen; ++b) seen = nodes[count][b] == p[a];
+				if (!seen) nodes[count][k++] = p[a];
+			}
+			std::sort(nodes[count], nodes[count] + k);
+			size[count] = k;
+			count += 1;
+		}
+
+		bool Contains(int const *f, int n) const
+		{
+			for (int k = 0; k < count; ++k)
+				if (size[k] == n && std::equal(f, f + n, nodes[k])) return true;
+			return false;
+		}
+	};
+
+	//Node positions of the eight corners of element i; -1 for a blank corner
+	void Corners(Elements const &e, size_t i, int p[8])
+	{
+		p[0] = e.n1[i] - 1; p[1] = e.n2[i] - 1; p[2] = e.n3[i] - 1; p[3] = e.n4[i] - 1;
+		p[4] = e.n5[i] - 1; p[5] = e.n6[i] - 1; p[6] = e.n7[i] - 1; p[7] = e.n8[i] - 1;
+	}
+
+	Facets ElementFacets(Elements const &e, size_t i)
+	{
+		int p[8];
+		Corners(e, i, p);
+		Facets F;
+		F.count = 0;
+		if (p[4] < 0 && p[5] < 0 && p[6] < 0 && p[7] < 0)
+		{
+			//a shell or a two node element: the distinct corners in order around the element
+			int ring[4], n = 0;
+			for (int k = 0; k < 4; ++k)
+				if (p[k] >= 0 && std::find(ring, ring + n, p[k]) == ring + n) ring[n++] = p[k];
+			if (n == 2) {
+				F.Add(ring, 1);
+				F.Add(ring + 1, 1);
+			}
+			else if (n > 2) {
+				for (int k = 0; k < n; ++k)
+				{
+					int edge[2] = { ring[k], ring[(k + 1) % n] };
+					F.Add(edge, 2);
+				}
+			}
+		}
+		else if (p[3] == p[4] && p[4] == p[5] && p[5] == p[6] && p[6] == p[7])
+		{
+			for (int f = 0; f < 4; ++f)
+			{
+				int face[3] = { p[TET_FACES[f][0]], p[TET_FACES[f][1]], p[TET_FACES[f][2]] };
+				F.Add(face, 3);
+			}
+		}
+		else
+		{
+			//faces of wedges and pyramids collapse to triangles, edges or points; only real faces are kept
+			for (int f = 0; f < 6; ++f)
+			{
+				int face[4] = { p[HEX_FACES[f][0]], p[HEX_FACES[f][1]], p[HEX_FACES[f][2]], p[HEX_FACES[f][3]] };
+				F.Add(face, 4);
+				if (F.size[F.count - 1] < 3) F.count -= 1;
+			}
+		}
+		return F;
+	}
+
+	//Turns offsets[r + 1] = length of row r into offsets[r + 1] = end of row r.  Each block is summed in
+	//parallel, the block totals are summed in order, and each block then adds the total of the blocks
+	//before it.
+	void PrefixSum(vector<int64_t> &offsets)
+	{
+		size_t n = offsets.size();
+		size_t nBlocks = (n + BLOCK - 1) / BLOCK;
+		vector<int64_t> totals(nBlocks + 1, 0);
+		ParallelFor(nBlocks, [&](size_t b, size_t e) {
+			for (size_t k = b; k < e; ++k)
+			{
+				size_t first = k * BLOCK, last = std::min(n, first + BLOCK);
+				for (size_t r = first + 1; r < last; ++r) offsets[r] += offsets[r - 1];
+				totals[k + 1] = offsets[last - 1];
+			}
+		}, 1);
+		for (size_t k = 1; k <= nBlocks; ++k) totals[k] += totals[k - 1];
+		ParallelFor(nBlocks, [&](size_t b, size_t e) {
+			for (size_t k = b; k < e; ++k)
+			{
+				size_t first = k * BLOCK, last = std::min(n, first + BLOCK);
+				for (size_t r = first; r < last; ++r) offsets[r] += totals[k];
+			}
+		}, 1);
+	}
+}
+
+CsrAdjacency NodeElementAdjacency(FiniteElementObject const &obj)
+{
+	ScopedTimer timer("NodeElementAdjacency");
+	Elements const &e = obj.elements;
+	size_t nNodes = obj.nodes.nids.size(), nElements = e.eids.size();
+
+	std::atomic<bool> misnumbered(false);
+	ParallelFor(nNodes, [&](size_t b, size_t end_) {
+		for (size_t j = b; j < end_; ++j)
+			if (obj.nodes.nids[j] != static_cast<double>(j + 1)) misnumbered = true;
+	});
+	if (misnumbered) throw std::invalid_argument("Adjacency is built on a part renumbered from 1.");
+
+	//count the elements of each node
+	vector<std::atomic<int>> degree(nNodes);
+	ParallelFor(nNodes, [&](size_t b, size_t end_) {
+		for (size_t j = b; j < end_; ++j) degree[j].store(0, std::memory_order_relaxed);
+	});
+	std::atomic<bool> out_of_range(false);
+	ParallelFor(nElements, [&](size_t b, size_t end_) {
+		int p[8];
+		for (size_t i = b; i < end_; ++i)
+		{
+			Corners(e, i, p);
+			for (int k = 0; k < 8; ++k)
+			{
+				if (p[k] < 0 || std::find(p, p + k, p[k]) != p + k) continue;
+				if (static_cast<size_t>(p[k]) >= nNodes) out_of_range = true;
+				else degree[p[k]].fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	});
+	if (out_of_range) throw std::runtime_error("An element of the part refers to a node that is not in the part.");
+
+	CsrAdjacency A;
+	A.offsets.assign(nNodes + 1, 0);
+	ParallelFor(nNodes, [&](size_t b, size_t end_) {
+		for (size_t j = b; j < end_; ++j)
+		{
+			A.offsets[j + 1] = degree[j].load(std::memory_order_relaxed);
+			degree[j].store(0, std::memory_order_relaxed);
+		}
+	});
+	PrefixSum(A.offsets);
+
+	//scatter; the degrees are reused as the fill position of each row
+	A.entries.resize(static_cast<size_t>(A.offsets.back()));
+	ParallelFor(nElements, [&](size_t b, size_t end_) {
+		int p[8];
+		for (size_t i = b; i < end_; ++i)
+		{
+			Corners(e, i, p);
+			for (int k = 0; k < 8; ++k)
+			{
+				if (p[k] < 0 || std::find(p, p + k, p[k]) != p + k) continue;
+				int slot = degree[p[k]].fetch_add(1, std::memory_order_relaxed);
+				A.entries[static_cast<size_t>(A.offsets[p[k]] + slot)] = static_cast<int>(i);
+			}
+		}
+	});
+
+	//the threads fill a row in no particular order
+	ParallelFor(nNodes, [&](size_t b, size_t end_) {
+		for (size_t j = b; j < end_; ++j) std::sort(A.entries.begin() + A.offsets[j], A.entries.begin() + A.offsets[j + 1]);
+	});
+	return A;
+}
+
+CsrAdjacency FaceNeighbors(FiniteElementObject const &obj, CsrAdjacency const &node_elements)
+{
+	ScopedTimer timer("FaceNeighbors");
+	Elements const &e = obj.elements;
+	size_t nElements = e.eids.size();
+	size_t nBlocks = (nElements + BLOCK - 1) / BLOCK;
+
+	//each block of elements collects its neighbors on its own; the blocks are then copied into place
+	CsrAdjacency A;
+	A.offsets.assign(nElements + 1, 0);
+	vector<vector<int>> found(nBlocks);
+	ParallelFor(nBlocks, [&](size_t b, size_t end_) {
+		vector<int> row;
+		for (size_t k = b; k < end_; ++k)
+		{
+			size_t first = k * BLOCK, last = std::min(nElements, first + BLOCK);
+			for (size_t i = first; i < last; ++i)
+			{
+				Facets F = ElementFacets(e, i);
+				row.clear();
+				for (int f = 0; f < F.count; ++f)
+				{
+					//only elements of the least used node of a facet can share it
+					int const *facet = F.nodes[f];
+					int pivot = facet[0];
+					for (int a = 1; a < F.size[f]; ++a)
+						if (node_elements.Degree(facet[a]) < node_elements.Degree(pivot)) pivot = facet[a];
+					for (int const *c = node_elements.RowBegin(pivot); c != node_elements.RowEnd(pivot); ++c)
+					{
+						if (*c == static_cast<int>(i)) continue;
+
+						//most candidates share only the pivot and are turned away before their facets are found
+						int q[8];
+						Corners(e, *c, q);
+						bool uses_all = true;
+						for (int a = 0; a < F.size[f] && uses_all; ++a) uses_all = std::find(q, q + 8, facet[a]) != q + 8;
+						if (uses_all && ElementFacets(e, *c).Contains(facet, F.size[f])) row.push_back(*c);
+					}
+				}
+				std::sort(row.begin(), row.end());
+				row.erase(std::unique(row.begin(), row.end()), row.end());
+				A.offsets[i + 1] = static_cast<int64_t>(row.size());
+				found[k].insert(found[k].end(), row.begin(), row.end());
+			}
+		}
+	}, 1);
+	PrefixSum(A.offsets);
+
+	A.entries.resize(static_cast<size_t>(A.offsets.back()));
+	ParallelFor(nBlocks, [&](size_t b, size_t end_) {
+		for (size_t k = b; k < end_; ++k)
+		{
+			std::copy(found[k].begin(), found[k].end(), A.entries.begin() + A.offsets[k * BLOCK]);
+			vector<int>().swap(found[k]);
+		}
+	}, 1);
+	return A;
+}
+
+void OutputAdjacency(string const &file_name, CsrAdjacency const &adjacency, bool overwrite)
+{
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		std::ofstream f(outfile.string());
+		for (size_t r = 0; r < adjacency.Rows(); ++r)
+		{
+			f << r + 1;
+			for (int const *c = adjacency.RowBegin(r); c != adjacency.RowEnd(r); ++c) f << "\t" << *c + 1;
+			f << "\n";
+		}
+		Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(f.tellp()));
+	}
+}
+
+void OutputColumnarAdjacency(string const &file_name, CsrAdjacency const &node_elements, CsrAdjacency const &neighbors, bool overwrite)
+{
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		ColumnarWriter w(outfile);
+		vector<int> numbered(node_elements.entries.size());
+		for (size_t k = 0; k < numbered.size(); ++k) numbered[k] = node_elements.entries[k] + 1;
+		w.AddIds("node_offsets", node_elements.offsets);
+		w.AddIds("node_elements", numbered);
+
+		numbered.resize(neighbors.entries.size());
+		for (size_t k = 0; k < numbered.size(); ++k) numbered[k] = neighbors.entries[k] + 1;
+		w.AddIds("element_offsets", neighbors.offsets);
+		w.AddIds("element_neighbors", numbered);
+		w.Close();
+	}
+}
+
+}
@@ -0,0 +1,64 @@
+// Adjacency.h : Node to element and element to element adjacency of a renumbered part, in compressed sparse row form.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <cstdint>
+
+namespace d2r
+{
+
+//The entries of row r are entries[offsets[r]] through entries[offsets[r + 1] - 1], in ascending order.
+//All of the rows share the two arrays, so a row costs one offset instead of a vector of its own.
+struct CsrAdjacency
+{
+	vector<int64_t> offsets;	//one more than the number of rows; offsets[0] is 0
+	vector<int> entries;
+
+	size_t Rows() const
+	{
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+
+	size_t Degree(size_t row) const
+	{
+		return static_cast<size_t>(offsets[row + 1] - offsets[row]);
+	}
+
+	int const * RowBegin(size_t row) const
+	{
+		return entries.data() + offsets[row];
+	}
+
+	int const * RowEnd(size_t row) const
+	{
+		return entries.data() + offsets[row + 1];
+	}
+};
+
+//The elements that use each node.  Rows are positions in obj.nodes and entries are positions in
+//obj.elements, both counted from 0; a degenerate element that repeats a node is listed once for it.
+//The object must be numbered as Renumber_Nodes numbers it, node j having ID j + 1; throws otherwise.
+//Built in three parallel passes: the uses of each node are counted, the counts are prefix summed into
+//the offsets, and the elements are scattered into their rows.
+CsrAdjacency NodeElementAdjacency(FiniteElementObject const &obj);
+
+//The elements that share a face with each element, found through the elements of the face's least used
+//node.  The facets of an element are inferred from its connectivity: the faces of a solid (hexahedra,
+//and wedges, pyramids and tetrahedra written as degenerate hexahedra), the edges of a shell (n5..n8
+//blank) and the ends of a two node element.  Two elements are neighbors when they have a facet with
+//the same nodes, so a shell lying on a solid is not a neighbor of it.
+CsrAdjacency FaceNeighbors(FiniteElementObject const &obj, CsrAdjacency const &node_elements);
+
+//One row per line: the number of the row and then its entries, tab separated.  Rows and entries are
+//numbered from 1, as the nodes and elements of the exported part are.
+void OutputAdjacency(string const &file_name, CsrAdjacency const &adjacency, bool overwrite = false);
+
+//Both adjacencies as the columns node_offsets, node_elements, element_offsets and element_neighbors of
+//a .d2rc file.  Offsets are positions in the entry column, from 0; entries are numbered from 1.
+void OutputColumnarAdjacency(string const &file_name, CsrAdjacency const &node_elements, CsrAdjacency const &neighbors, bool overwrite = false);
+
+}
@@ -0,0 +1,108 @@
+// CInterface.cpp : C ABI for the LSDynaToRaw library, implemented on top of d2r::Model.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "CInterface.h"
+#include "Model.h"
+
+struct d2r_model
+{
+	d2r::Model model;
+};
+
+namespace
+{
+	thread_local std::string last_error;
+
+	//Runs f, converting any exception into a return code and a message for d2r_last_error
+	template <typename F>
+	int Guard(F f)
+	{
+		try {
+			f();
+			return 0;
+		}
+		catch (std::exception &e) {
+			last_error = e.what();
+		}
+		catch (...) {
+			last_error = "Unknown error";
+		}
+		return -1;
+	}
+}
+
+d2r_model *d2r_model_create(void)
+{
+	d2r_model *m = nullptr;
+	Guard([&]() {
+		m = new d2r_model;
+		m->model.SetVerbose(false);
+	});
+	return m;
+}
+
+void d2r_model_destroy(d2r_model *model)
+{
+	delete model;
+}
+
+int d2r_model_append(d2r_model *model, const char *file_name)
+{
+	return Guard([&]() {
+		model->model.Append(file_name);
+	});
+}
+
+int d2r_model_merge_nodes(d2r_model *model, double tolerance, int *num_merged)
+{
+	return Guard([&]() {
+		int n = model->model.MergeCoincidentNodes(tolerance);
+		if (num_merged) *num_merged = n;
+	});
+}
+
+int d2r_model_part_count(const d2r_model *model, size_t *count)
+{
+	return Guard([&]() {
+		*count = model->model.GetPartIDs().size();
+	});
+}
+
+int d2r_model_part_ids(const d2r_model *model, int *part_ids, size_t capacity)
+{
+	return Guard([&]() {
+		std::vector<int> pids = model->model.GetPartIDs();
+		std::copy_n(pids.begin(), std::min(capacity, pids.size()), part_ids);
+	});
+}
+
+int d2r_model_get_part(d2r_model *model, int part_id, int renumber, d2r_part_view *view)
+{
+	return Guard([&]() {
+		d2r::PartView v = model->model.GetPartView(part_id, renumber != 0);
+		view->part_id = v.pid;
+		view->name = v.name;
+		view->num_nodes = v.num_nodes;
+		view->node_ids = v.nids;
+		view->x = v.x;
+		view->y = v.y;
+		view->z = v.z;
+		view->num_elements = v.num_elements;
+		view->element_ids = v.eids;
+		view->part_ids = v.pids;
+		for (int k = 0; k < 8; ++k) view->connectivity[k] = v.n[k];
+	});
+}
+
+int d2r_model_write_part(d2r_model *model, int part_id, const char *base_name, int renumber)
+{
+	return Guard([&]() {
+		model->model.WritePart(part_id, base_name, renumber != 0, true);
+	});
+}
+
+const char *d2r_last_error(void)
+{
+	return last_error.c_str();
+}
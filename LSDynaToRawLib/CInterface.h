@@ -0,0 +1,69 @@
+/* CInterface.h : C ABI for the LSDynaToRaw library.
+ *
+ * All functions return 0 on success and -1 on failure; d2r_last_error() then describes the failure
+ * that occurred most recently on the calling thread.  Part views point into arrays owned by the model
+ * and remain valid until the model is modified (append, merge) or destroyed.
+ *
+ * Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(D2R_BUILD_DLL)
+#define D2R_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(D2R_USE_DLL)
+#define D2R_API __declspec(dllimport)
+#else
+#define D2R_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct d2r_model d2r_model;
+
+typedef struct d2r_part_view
+{
+	int part_id;
+	const char *name;
+
+	size_t num_nodes;
+	const double *node_ids;
+	const double *x;
+	const double *y;
+	const double *z;
+
+	size_t num_elements;
+	const int *element_ids;
+	const int *part_ids;
+	const int *connectivity[8]; /* columns n1..n8; 0 marks an unused corner */
+} d2r_part_view;
+
+D2R_API d2r_model *d2r_model_create(void);
+
+D2R_API void d2r_model_destroy(d2r_model *model);
+
+/* Parses a keyfile and adds its nodes, elements and parts to the model */
+D2R_API int d2r_model_append(d2r_model *model, const char *file_name);
+
+D2R_API int d2r_model_merge_nodes(d2r_model *model, double tolerance, int *num_merged);
+
+D2R_API int d2r_model_part_count(const d2r_model *model, size_t *count);
+
+/* Copies up to capacity part IDs into part_ids */
+D2R_API int d2r_model_part_ids(const d2r_model *model, int *part_ids, size_t capacity);
+
+/* Isolates a part, optionally renumbering nodes and elements from 1, and returns a view of it */
+D2R_API int d2r_model_get_part(d2r_model *model, int part_id, int renumber, d2r_part_view *view);
+
+/* Writes <base_name>-nodes.txt and <base_name>-elements.txt, replacing existing files */
+D2R_API int d2r_model_write_part(d2r_model *model, int part_id, const char *base_name, int renumber);
+
+D2R_API const char *d2r_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
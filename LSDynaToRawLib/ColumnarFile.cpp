@@ -0,0 +1,418 @@
+// ColumnarFile.cpp : Compressed columnar container for the nodes and elements of a part.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "ColumnarFile.h"
+#include "MeshTools.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/copy.hpp>
+
+namespace d2r
+{
+
+namespace
+{
+	const char COLUMNAR_MAGIC[8] = { 'D', '2', 'R', 'C', 'O', 'L', '1', '\n' };
+
+	const size_t CHUNK_VALUES = size_t(1) << 16;
+
+	template <typename T>
+	void Put(std::ostream &f, T value)
+	{
+		f.write(reinterpret_cast<char const*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	T Get(std::istream &f)
+	{
+		T value;
+		f.read(reinterpret_cast<char*>(&value), sizeof(T));
+		if (!f) throw std::runtime_error("The columnar file is truncated.");
+		return value;
+	}
+
+	string EncodeIds(int64_t const *ids, size_t n)
+	{
+		string out;
+		out.reserve(n * 2);
+		int64_t previous = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			uint64_t delta = static_cast<uint64_t>(ids[i]) - static_cast<uint64_t>(previous);
+			uint64_t zigzag = (delta << 1) ^ (0 - (delta >> 63)); //small negative differences stay small
+			previous = ids[i];
+			while (zigzag >= 0x80)
+			{
+				out.push_back(static_cast<char>(zigzag | 0x80));
+				zigzag >>= 7;
+			}
+			out.push_back(static_cast<char>(zigzag));
+		}
+		return out;
+	}
+
+	void DecodeIds(string const &in, size_t n, int64_t *ids)
+	{
+		unsigned char const *p = reinterpret_cast<unsigned char const*>(in.data());
+		unsigned char const *end = p + in.size();
+		uint64_t previous = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			uint64_t zigzag = 0;
+			for (int shift = 0; ; shift += 7)
+			{
+				if (p == end || shift > 63) throw std::runtime_error("A column of the columnar file is corrupt.");
+				zigzag |= static_cast<uint64_t>(*p & 0x7F) << shift;
+				if (!(*p++ & 0x80)) break;
+			}
+			uint64_t delta = (zigzag >> 1) ^ (0 - (zigzag & 1));
+			previous += delta;
+			ids[i] = static_cast<int64_t>(previous);
+		}
+	}
+
+	//Neighboring coordinates share their sign, exponent and leading mantissa bytes; grouping the bytes
+	//by position turns that into long runs the compressor can use
+	string ShuffleValues(double const *values, size_t n)
+	{
+		string out(n * sizeof(double), '\0');
+		unsigned char const *bytes = reinterpret_cast<unsigned char const*>(values);
+		for (size_t b = 0; b < sizeof(double); ++b)
+		{
+			char *plane = &out[b * n];
+			for (size_t i = 0; i < n; ++i) plane[i] = static_cast<char>(bytes[i * sizeof(double) + b]);
+		}
+		return out;
+	}
+
+	void UnshuffleValues(string const &in, size_t n, double *values)
+	{
+		if (in.size() != n * sizeof(double)) throw std::runtime_error("A column of the columnar file is corrupt.");
+		unsigned char *bytes = reinterpret_cast<unsigned char*>(values);
+		for (size_t b = 0; b < sizeof(double); ++b)
+		{
+			char const *plane = &in[b * n];
+			for (size_t i = 0; i < n; ++i) bytes[i * sizeof(double) + b] = static_cast<unsigned char>(plane[i]);
+		}
+	}
+
+	string Compress(string const &in)
+	{
+		namespace io = boost::iostreams;
+		string out;
+		io::filtering_ostream s;
+		s.push(io::zstd_compressor());
+		s.push(io::back_inserter(out));
+		s.write(in.data(), static_cast<std::streamsize>(in.size()));
+		s.reset();
+		return out;
+	}
+
+	string Decompress(string const &in, size_t size)
+	{
+		namespace io = boost::iostreams;
+		string out;
+		out.reserve(size);
+		io::filtering_istream s;
+		s.push(io::zstd_decompressor());
+		s.push(io::array_source(in.data(), in.size()));
+		io::copy(s, io::back_inserter(out));
+		if (out.size() != size) throw std::runtime_error("A column of the columnar file is corrupt.");
+		return out;
+	}
+}
+
+ColumnarWriter::ColumnarWriter(fs::path const &file_)
+	: file(file_)
+	, closed(false)
+{
+	f.open(file.string(), std::ios_base::out | std::ios_base::binary);
+	if (f.fail()) throw std::runtime_error("Could not write " + file.string());
+	f.write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+}
+
+ColumnarWriter::~ColumnarWriter()
+{
+	try {
+		Close();
+	}
+	catch (std::exception &) {
+	}
+}
+
+void ColumnarWriter::AddIds(string const &name, vector<int> const &ids)
+{
+	vector<int64_t> wide(ids.begin(), ids.end());
+	AddColumn(name, DELTA_VARINT, wide.size(), wide.data());
+}
+
+void ColumnarWriter::AddIds(string const &name, vector<int64_t> const &ids)
+{
+	AddColumn(name, DELTA_VARINT, ids.size(), ids.data());
+}
+
+void ColumnarWriter::AddIds(string const &name, vector<double> const &ids)
+{
+	vector<int64_t> wide(ids.size());
+	for (size_t i = 0; i < ids.size(); ++i) wide[i] = static_cast<int64_t>(std::llround(ids[i]));
+	AddColumn(name, DELTA_VARINT, wide.size(), wide.data());
+}
+
+void ColumnarWriter::AddValues(string const &name, vector<double> const &values)
+{
+	AddColumn(name, SHUFFLED_DOUBLE, values.size(), values.data());
+}
+
+void ColumnarWriter::AddColumn(string const &name, ColumnEncoding encoding, size_t count, void const *data)
+{
+	ScopedTimer timer("WriteColumn");
+	if (closed) throw std::logic_error("Columns cannot be added to a columnar file after it is closed.");
+	size_t nChunks = (count + CHUNK_VALUES - 1) / CHUNK_VALUES;
+	vector<string> stored(nChunks);
+	vector<uint64_t> encoded_size(nChunks);
+	std::atomic<bool> failed(false);
+	ParallelFor(nChunks, [&](size_t b, size_t e) {
+		try {
+			for (size_t c = b; c < e; ++c)
+			{
+				size_t first = c * CHUNK_VALUES;
+				size_t n = std::min(CHUNK_VALUES, count - first);
+				string encoded = encoding == DELTA_VARINT
+					? EncodeIds(static_cast<int64_t const*>(data) + first, n)
+					: ShuffleValues(static_cast<double const*>(data) + first, n);
+				encoded_size[c] = encoded.size();
+				stored[c] = Compress(encoded);
+			}
+		}
+		catch (std::exception &) {
+			failed = true;
+		}
+	}, 1);
+	if (failed) throw std::runtime_error("Could not compress the column " + name + " of " + file.string());
+
+	Column column;
+	column.name = name;
+	column.encoding = encoding;
+	column.count = count;
+	for (size_t c = 0; c < nChunks; ++c)
+	{
+		Chunk chunk;
+		chunk.offset = static_cast<uint64_t>(f.tellp());
+		chunk.stored_size = stored[c].size();
+		chunk.encoded_size = encoded_size[c];
+		chunk.count = static_cast<uint32_t>(std::min(CHUNK_VALUES, count - c * CHUNK_VALUES));
+		f.write(stored[c].data(), static_cast<std::streamsize>(stored[c].size()));
+		column.chunks.push_back(chunk);
+	}
+	if (f.fail()) throw std::runtime_error("Could not write " + file.string());
+	columns.push_back(column);
+}
+
+void ColumnarWriter::Close()
+{
+	if (closed) return;
+	closed = true;
+	uint64_t directory = static_cast<uint64_t>(f.tellp());
+	Put(f, static_cast<uint32_t>(columns.size()));
+	for (auto it = columns.begin(); it != columns.end(); ++it)
+	{
+		Put(f, static_cast<uint32_t>(it->name.size()));
+		f.write(it->name.data(), static_cast<std::streamsize>(it->name.size()));
+		Put(f, static_cast<uint8_t>(it->encoding));
+		Put(f, it->count);
+		Put(f, static_cast<uint32_t>(it->chunks.size()));
+		for (auto c = it->chunks.begin(); c != it->chunks.end(); ++c)
+		{
+			Put(f, c->offset);
+			Put(f, c->stored_size);
+			Put(f, c->encoded_size);
+			Put(f, c->count);
+		}
+	}
+	Put(f, directory);
+	f.write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+	Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(f.tellp()));
+	f.close();
+	if (f.fail()) throw std::runtime_error("Could not write " + file.string());
+}
+
+ColumnarReader::ColumnarReader(fs::path const &file_)
+	: file(file_)
+{
+	f.open(file.string(), std::ios_base::in | std::ios_base::binary);
+	if (f.fail()) throw std::runtime_error("Could not open " + file.string());
+
+	char magic[sizeof(COLUMNAR_MAGIC)];
+	f.seekg(-static_cast<std::streamoff>(sizeof(uint64_t) + sizeof(magic)), std::ios_base::end);
+	uint64_t directory = Get<uint64_t>(f);
+	if (!f.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), COLUMNAR_MAGIC))
+		throw std::runtime_error(file.string() + " is not a columnar file.");
+
+	f.seekg(static_cast<std::streamoff>(directory));
+	uint32_t nColumns = Get<uint32_t>(f);
+	for (uint32_t i = 0; i < nColumns; ++i)
+	{
+		string name(Get<uint32_t>(f), '\0');
+		f.read(&name[0], static_cast<std::streamsize>(name.size()));
+		Column column;
+		column.encoding = static_cast<ColumnEncoding>(Get<uint8_t>(f));
+		column.count = Get<uint64_t>(f);
+		uint32_t nChunks = Get<uint32_t>(f);
+		for (uint32_t c = 0; c < nChunks; ++c)
+		{
+			Chunk chunk;
+			chunk.offset = Get<uint64_t>(f);
+			chunk.stored_size = Get<uint64_t>(f);
+			chunk.encoded_size = Get<uint64_t>(f);
+			chunk.count = Get<uint32_t>(f);
+			column.chunks.push_back(chunk);
+		}
+		columns[name] = column;
+		names.push_back(name);
+	}
+}
+
+vector<string> ColumnarReader::GetColumnNames() const
+{
+	return names;
+}
+
+bool ColumnarReader::HasColumn(string const &name) const
+{
+	return columns.count(name) > 0;
+}
+
+ColumnarReader::Column const & ColumnarReader::Load(string const &name, ColumnEncoding encoding, vector<string> &encoded, vector<size_t> &first)
+{
+	auto it = columns.find(name);
+	if (it == columns.end()) throw std::out_of_range(file.string() + " has no column " + name);
+	Column const &column = it->second;
+	if (column.encoding != encoding) throw std::invalid_argument("The column " + name + " does not hold " + (encoding == DELTA_VARINT ? "IDs" : "values"));
+
+	//the chunks are read in order, then decompressed in parallel
+	size_t nChunks = column.chunks.size();
+	vector<string> stored(nChunks);
+	first.assign(nChunks, 0);
+	for (size_t c = 0; c < nChunks; ++c)
+	{
+		Chunk const &chunk = column.chunks[c];
+		stored[c].resize(static_cast<size_t>(chunk.stored_size));
+		f.seekg(static_cast<std::streamoff>(chunk.offset));
+		f.read(&stored[c][0], static_cast<std::streamsize>(chunk.stored_size));
+		if (!f) throw std::runtime_error("The columnar file is truncated.");
+		if (c + 1 < nChunks) first[c + 1] = first[c] + chunk.count;
+	}
+
+	encoded.assign(nChunks, string());
+	std::atomic<bool> corrupt(false);
+	ParallelFor(nChunks, [&](size_t b, size_t e) {
+		try {
+			for (size_t c = b; c < e; ++c)
+				encoded[c] = Decompress(stored[c], static_cast<size_t>(column.chunks[c].encoded_size));
+		}
+		catch (std::exception &) {
+			corrupt = true;
+		}
+	}, 1);
+	if (corrupt) throw std::runtime_error("The column " + name + " of " + file.string() + " is corrupt.");
+	return column;
+}
+
+vector<int64_t> ColumnarReader::ReadIds(string const &name)
+{
+	ScopedTimer timer("ReadColumn");
+	vector<string> encoded;
+	vector<size_t> first;
+	Column const &column = Load(name, DELTA_VARINT, encoded, first);
+	vector<int64_t> ids(static_cast<size_t>(column.count));
+	std::atomic<bool> corrupt(false);
+	ParallelFor(encoded.size(), [&](size_t b, size_t e) {
+		try {
+			for (size_t c = b; c < e; ++c) DecodeIds(encoded[c], column.chunks[c].count, ids.data() + first[c]);
+		}
+		catch (std::exception &) {
+			corrupt = true;
+		}
+	}, 1);
+	if (corrupt) throw std::runtime_error("The column " + name + " of " + file.string() + " is corrupt.");
+	return ids;
+}
+
+vector<double> ColumnarReader::ReadValues(string const &name)
+{
+	ScopedTimer timer("ReadColumn");
+	vector<string> encoded;
+	vector<size_t> first;
+	Column const &column = Load(name, SHUFFLED_DOUBLE, encoded, first);
+	vector<double> values(static_cast<size_t>(column.count));
+	std::atomic<bool> corrupt(false);
+	ParallelFor(encoded.size(), [&](size_t b, size_t e) {
+		try {
+			for (size_t c = b; c < e; ++c) UnshuffleValues(encoded[c], column.chunks[c].count, values.data() + first[c]);
+		}
+		catch (std::exception &) {
+			corrupt = true;
+		}
+	}, 1);
+	if (corrupt) throw std::runtime_error("The column " + name + " of " + file.string() + " is corrupt.");
+	return values;
+}
+
+Nodes ColumnarReader::ReadNodes()
+{
+	Nodes n;
+	vector<int64_t> nids = ReadIds("nids");
+	n.nids.assign(nids.begin(), nids.end());
+	n.x = ReadValues("x");
+	n.y = ReadValues("y");
+	n.z = ReadValues("z");
+	return n;
+}
+
+Elements ColumnarReader::ReadElements()
+{
+	Elements e;
+	vector<int> *targets[10] = { &e.eids, &e.pids, &e.n1, &e.n2, &e.n3, &e.n4, &e.n5, &e.n6, &e.n7, &e.n8 };
+	char const *names[10] = { "eids", "pids", "n1", "n2", "n3", "n4", "n5", "n6", "n7", "n8" };
+	for (int k = 0; k < 10; ++k)
+	{
+		vector<int64_t> ids = ReadIds(names[k]);
+		targets[k]->assign(ids.begin(), ids.end());
+	}
+	return e;
+}
+
+void OutputColumnar(string const &file_name, FiniteElementObject const &obj, bool overwrite)
+{
+	ScopedTimer timer("OutputColumnar");
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		ColumnarWriter w(outfile);
+		w.AddIds("nids", obj.nodes.nids);
+		w.AddValues("x", obj.nodes.x);
+		w.AddValues("y", obj.nodes.y);
+		w.AddValues("z", obj.nodes.z);
+		w.AddIds("eids", obj.elements.eids);
+		w.AddIds("pids", obj.elements.pids);
+		w.AddIds("n1", obj.elements.n1);
+		w.AddIds("n2", obj.elements.n2);
+		w.AddIds("n3", obj.elements.n3);
+		w.AddIds("n4", obj.elements.n4);
+		w.AddIds("n5", obj.elements.n5);
+		w.AddIds("n6", obj.elements.n6);
+		w.AddIds("n7", obj.elements.n7);
+		w.AddIds("n8", obj.elements.n8);
+		w.Close();
+	}
+}
+
+}
@@ -0,0 +1,125 @@
+// ColumnarFile.h : Compressed columnar container for the nodes and elements of a part.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <cstdint>
+
+namespace d2r
+{
+
+//A .d2rc file holds one column per array of a part: nids, x, y, z, eids, pids and n1..n8.  Each
+//column is cut into chunks of up to 65536 values that are encoded and zstd compressed independently,
+//so chunks are written and read in parallel, and a directory at the end of the file lets a reader
+//find one column without touching the others.
+//  ID columns			zigzag encoded differences from the previous value, as LEB128 varints
+//  coordinate columns	doubles, byte shuffled (all first bytes, then all second bytes, ...)
+//
+//Layout, little endian:
+//  "D2RCOL1\n"
+//  compressed chunks
+//  directory:	uint32 column count, then for each column
+//				  uint32 name length, name, uint8 encoding, uint64 value count, uint32 chunk count,
+//				  and for each chunk uint64 offset, uint64 compressed size, uint64 encoded size, uint32 value count
+//  uint64 offset of the directory
+//  "D2RCOL1\n"
+enum ColumnEncoding
+{
+	DELTA_VARINT = 0,
+	SHUFFLED_DOUBLE = 1
+};
+
+class ColumnarWriter
+{
+public:
+	ColumnarWriter(fs::path const &file);
+
+	~ColumnarWriter();
+
+	void AddIds(string const &name, vector<int> const &ids);
+
+	void AddIds(string const &name, vector<int64_t> const &ids);
+
+	//Node IDs are stored as doubles in memory but are whole numbers, so they are encoded as IDs
+	void AddIds(string const &name, vector<double> const &ids);
+
+	void AddValues(string const &name, vector<double> const &values);
+
+	//Writes the directory; called by the destructor if it has not been called
+	void Close();
+
+private:
+	struct Chunk
+	{
+		uint64_t offset;
+		uint64_t stored_size;
+		uint64_t encoded_size;
+		uint32_t count;
+	};
+
+	struct Column
+	{
+		string name;
+		ColumnEncoding encoding;
+		uint64_t count;
+		vector<Chunk> chunks;
+	};
+
+	void AddColumn(string const &name, ColumnEncoding encoding, size_t count, void const *data);
+
+	std::ofstream		f;
+	fs::path			file;
+	vector<Column>		columns;
+	bool				closed;
+};
+
+class ColumnarReader
+{
+public:
+	ColumnarReader(fs::path const &file);
+
+	vector<string> GetColumnNames() const;
+
+	bool HasColumn(string const &name) const;
+
+	//Decodes one column; throws if the column is missing or has the other encoding
+	vector<int64_t> ReadIds(string const &name);
+
+	vector<double> ReadValues(string const &name);
+
+	Nodes ReadNodes();
+
+	Elements ReadElements();
+
+private:
+	struct Chunk
+	{
+		uint64_t offset;
+		uint64_t stored_size;
+		uint64_t encoded_size;
+		uint32_t count;
+	};
+
+	struct Column
+	{
+		ColumnEncoding encoding;
+		uint64_t count;
+		vector<Chunk> chunks;
+	};
+
+	//Reads and decompresses the chunks of a column; fills in the encoded chunks and their first values
+	Column const & Load(string const &name, ColumnEncoding encoding, vector<string> &encoded, vector<size_t> &first);
+
+	std::ifstream				f;
+	fs::path					file;
+	std::map<string, Column>	columns;
+	vector<string>				names; //in the order they were written
+};
+
+//Writes the nodes and elements of a part as a .d2rc file
+void OutputColumnar(string const &file_name, FiniteElementObject const &obj, bool overwrite = false);
+
+}
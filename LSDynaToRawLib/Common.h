@@ -0,0 +1,30 @@
+// Common.h : Standard library and Boost declarations shared by the LSDynaToRaw library sources.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <map>
+#include <string>
+#include <stdexcept>
+#include <fstream>
+#include <memory>
+#include <boost/filesystem.hpp>
+
+namespace d2r
+{
+	namespace fs = boost::filesystem;
+	using std::cout;
+	using std::endl;
+	using std::string;
+	using std::vector;
+	using std::get;
+	using std::make_tuple;
+	using std::begin;
+	using std::end;
+	using std::map;
+}
@@ -0,0 +1,299 @@
+// D3Plot.cpp : Reader for the state data of an LS-Dyna d3plot binary database family.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "D3Plot.h"
+#include "MeshTools.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <boost/lexical_cast.hpp>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <unordered_map>
+
+namespace d2r
+{
+
+namespace
+{
+	//Offsets of the control words in the first 64 words of the database
+	enum ControlWord
+	{
+		NDIM = 15, NUMNP = 16, NGLBV = 18, IT = 19, IU = 20, IV = 21, IA = 22,
+		NEL8 = 23, NV3D = 27, NEL2 = 28, NV1D = 30, NEL4 = 31, NV2D = 33,
+		MAXINT = 36, NMSPH = 37, NARBS = 39, NELT = 40, NV3DT = 42,
+		IALEMAT = 47, NCFDV1 = 48, NCFDV2 = 49, NPEFG = 54, EXTRA = 57
+	};
+
+	const double END_OF_FILE_MARKER = -999999.0;
+
+	//Title and keyword sections that may follow the geometry start with one of these type codes
+	const long long TITLE_SECTION_MIN = 90000;
+	const long long TITLE_SECTION_MAX = 90002;
+
+	std::runtime_error Unsupported(string const &what)
+	{
+		return std::runtime_error("d3plot: " + what + " is not supported");
+	}
+
+	fs::path FamilyMember(fs::path const &base_file, size_t k)
+	{
+		char suffix[16];
+		std::snprintf(suffix, sizeof(suffix), "%02u", static_cast<unsigned>(k));
+		return fs::path(base_file.string() + suffix);
+	}
+}
+
+vector<fs::path> D3PlotFamily(fs::path const &base_file)
+{
+	if (!fs::is_regular_file(base_file)) throw std::invalid_argument("d3plot file " + base_file.string() + " does not exist.");
+	vector<fs::path> family(1, base_file);
+	for (size_t k = 1; fs::is_regular_file(FamilyMember(base_file, k)); ++k)
+	{
+		family.push_back(FamilyMember(base_file, k));
+	}
+	return family;
+}
+
+D3Plot::D3Plot(fs::path const &base_file)
+	: word_size(4)
+{
+	ScopedTimer timer("D3Plot");
+	vector<fs::path> family = D3PlotFamily(base_file);
+	for (auto it = family.begin(); it != family.end(); ++it)
+	{
+		files.push_back(std::make_unique<mapped_file>(it->string()));
+	}
+
+	size_t word = ReadHeader();
+
+	//states are fixed size; a file ends at its end of file marker or when a whole state no longer fits
+	for (size_t k = 0; k < files.size(); ++k, word = 0)
+	{
+		mapped_file const &f = *files[k];
+		while (word + state_size <= Words(f) && Real(f, word) != END_OF_FILE_MARKER)
+		{
+			StateLocation s = { k, word };
+			states.push_back(s);
+			word += state_size;
+		}
+	}
+}
+
+long long D3Plot::Int(mapped_file const &f, size_t word) const
+{
+	if (word_size == 4) {
+		int32_t v;
+		std::memcpy(&v, f.data() + word * 4, 4);
+		return v;
+	}
+	int64_t v;
+	std::memcpy(&v, f.data() + word * 8, 8);
+	return v;
+}
+
+double D3Plot::Real(mapped_file const &f, size_t word) const
+{
+	if (word_size == 4) {
+		float v;
+		std::memcpy(&v, f.data() + word * 4, 4);
+		return v;
+	}
+	double v;
+	std::memcpy(&v, f.data() + word * 8, 8);
+	return v;
+}
+
+size_t D3Plot::ReadHeader()
+{
+	mapped_file const &f = *files[0];
+
+	//a single precision file has a small NDIM in its 16th 4-byte word; otherwise try 8-byte words
+	if (f.size() < 64 * 4) throw std::runtime_error("d3plot: the file is too short to hold a control section");
+	long long ndim4 = Int(f, NDIM);
+	if (ndim4 < 2 || ndim4 > 7) {
+		word_size = 8;
+		if (f.size() < 64 * 8 || Int(f, NDIM) < 2 || Int(f, NDIM) > 7)
+			throw std::runtime_error("d3plot: unrecognized control section; the file may be from a machine with a different byte order");
+	}
+
+	long long raw_ndim = Int(f, NDIM);
+	numnp = Int(f, NUMNP);
+	nglbv = Int(f, NGLBV);
+	it = Int(f, IT);
+	iu = Int(f, IU);
+	iv = Int(f, IV);
+	ia = Int(f, IA);
+	long long nel8 = Int(f, NEL8), nelt = Int(f, NELT), nel2 = Int(f, NEL2), nel4 = Int(f, NEL4);
+	long long nv3d = Int(f, NV3D), nv3dt = Int(f, NV3DT), nv1d = Int(f, NV1D), nv2d = Int(f, NV2D);
+	long long maxint = Int(f, MAXINT);
+	long long narbs = Int(f, NARBS);
+	long long extra = Int(f, EXTRA);
+
+	if (it != 0 && it != 1) throw Unsupported("nodal temperature output other than IT=1");
+	if (nel8 < 0) throw Unsupported("ten node solid connectivity");
+	if (Int(f, NMSPH) > 0) throw Unsupported("SPH data");
+	if (Int(f, NCFDV1) != 0 || Int(f, NCFDV2) != 0) throw Unsupported("CFD nodal data");
+	if (Int(f, NPEFG) != 0) throw Unsupported("airbag particle data");
+
+	//NDIM 4 marks unpacked connectivity and NDIM 5 or 7 a material type section; all are 3D
+	ndim = raw_ndim >= 4 ? 3 : static_cast<size_t>(raw_ndim);
+	bool mattyp = raw_ndim == 5 || raw_ndim == 7;
+
+	size_t word = 64 + (extra > 0 ? static_cast<size_t>(extra) : 0);
+	if (mattyp) word += 2 + static_cast<size_t>(Int(f, word + 1)); //NUMRBE, NUMMAT, IRBTYP(NUMMAT)
+	if (Int(f, IALEMAT) > 0) word += static_cast<size_t>(Int(f, IALEMAT));
+
+	//geometry: coordinates, then solid, thick shell, beam and shell connectivity
+	reference.assign(3 * numnp, 0.0);
+	if (word + ndim * numnp > Words(f)) throw std::runtime_error("d3plot: the geometry section is truncated");
+	for (long long i = 0; i < numnp; ++i)
+		for (size_t d = 0; d < ndim; ++d)
+			reference[3 * i + d] = Real(f, word + ndim * i + d);
+	word += ndim * numnp;
+	word += 9 * nel8 + 9 * nelt + 6 * nel2 + 5 * nel4;
+
+	//the user ID block starts with 10 (or 16, if NSORT < 0) sort words, followed by the node IDs
+	if (narbs > 0) {
+		if (word + narbs > Words(f)) throw std::runtime_error("d3plot: the user ID section is truncated");
+		size_t nusern = word + (Int(f, word) < 0 ? 16 : 10);
+		user_ids.resize(numnp);
+		for (long long i = 0; i < numnp; ++i) user_ids[i] = Int(f, nusern + i);
+		word += narbs;
+	}
+
+	//part titles and keyword sections run up to the end of file marker that closes the geometry
+	if (word < Words(f)) {
+		long long type = Int(f, word);
+		if (type >= TITLE_SECTION_MIN && type <= TITLE_SECTION_MAX) {
+			while (word < Words(f) && Real(f, word) != END_OF_FILE_MARKER) ++word;
+		}
+		if (word < Words(f) && Real(f, word) == END_OF_FILE_MARKER) ++word;
+	}
+
+	//deletion flags follow the element data: one per node for MDLOPT 1, one per element for MDLOPT 2
+	size_t deletion = 0;
+	if (maxint < -10000) deletion = static_cast<size_t>(nel8 + nelt + nel4 + nel2);
+	else if (maxint < 0) deletion = static_cast<size_t>(numnp);
+
+	state_size = 1 + static_cast<size_t>(nglbv)
+		+ static_cast<size_t>(numnp) * (static_cast<size_t>(it) + ndim * static_cast<size_t>(iu + iv + ia))
+		+ static_cast<size_t>(nel8 * nv3d + nelt * nv3dt + nel2 * nv1d + nel4 * nv2d)
+		+ deletion;
+	return word;
+}
+
+double D3Plot::GetTime(size_t state) const
+{
+	StateLocation const &s = states.at(state);
+	return Real(*files[s.file], s.word);
+}
+
+vector<size_t> D3Plot::MapNodes(Nodes const &nodes) const
+{
+	std::unordered_map<long long, size_t> index;
+	if (!user_ids.empty()) {
+		index.reserve(user_ids.size());
+		for (size_t i = 0; i < user_ids.size(); ++i) index[user_ids[i]] = i;
+	}
+
+	vector<size_t> mapped(nodes.nids.size());
+	for (size_t j = 0; j < nodes.nids.size(); ++j)
+	{
+		long long nid = static_cast<long long>(nodes.nids[j]);
+		if (user_ids.empty()) {
+			if (nid < 1 || nid > numnp) throw std::out_of_range("Node " + boost::lexical_cast<string>(nid) + " is not in the d3plot database");
+			mapped[j] = static_cast<size_t>(nid - 1);
+		}
+		else {
+			auto found = index.find(nid);
+			if (found == index.end()) throw std::out_of_range("Node " + boost::lexical_cast<string>(nid) + " is not in the d3plot database");
+			mapped[j] = found->second;
+		}
+	}
+	return mapped;
+}
+
+void D3Plot::GatherReference(vector<size_t> const &node_index, double *xyz) const
+{
+	for (size_t j = 0; j < node_index.size(); ++j)
+		for (size_t d = 0; d < 3; ++d)
+			xyz[3 * j + d] = reference[3 * node_index[j] + d];
+}
+
+void D3Plot::GatherState(size_t state, vector<size_t> const &node_index, double *xyz, double *vxyz) const
+{
+	StateLocation const &s = states.at(state);
+	mapped_file const &f = *files[s.file];
+	size_t coordinates = s.word + 1 + static_cast<size_t>(nglbv) + static_cast<size_t>(it * numnp);
+	size_t velocities = coordinates + (iu ? ndim * numnp : 0);
+
+	for (size_t j = 0; j < node_index.size(); ++j)
+	{
+		size_t n = node_index[j];
+		for (size_t d = 0; d < 3; ++d)
+		{
+			if (xyz) xyz[3 * j + d] = (iu && d < ndim) ? Real(f, coordinates + ndim * n + d) : 0.0;
+			if (vxyz) vxyz[3 * j + d] = (iv && d < ndim) ? Real(f, velocities + ndim * n + d) : 0.0;
+		}
+	}
+}
+
+void OutputTimeHistory(string const &base_name, D3Plot const &d3plot, Nodes const &part_nodes, bool overwrite)
+{
+	ScopedTimer timer("OutputTimeHistory");
+	vector<size_t> node_index = d3plot.MapNodes(part_nodes);
+	size_t nNodes = node_index.size();
+	size_t nStates = d3plot.GetNumStates();
+
+	fs::path times_file(base_name + "-times.txt");
+	fs::path displacement_file(base_name + "-displacements.bin");
+	fs::path velocity_file(base_name + "-velocities.bin");
+	bool write_times = overwrite || ConfirmOverwrite(times_file);
+	bool write_displacements = d3plot.HasCoordinates() && (overwrite || ConfirmOverwrite(displacement_file));
+	bool write_velocities = d3plot.HasVelocities() && (overwrite || ConfirmOverwrite(velocity_file));
+
+	if (write_times) {
+		std::ofstream f(times_file.string());
+		f.precision(16);
+		for (size_t s = 0; s < nStates; ++s) f << d3plot.GetTime(s) << endl;
+	}
+
+	std::ofstream displacements, velocities;
+	if (write_displacements) displacements.open(displacement_file.string(), std::ios_base::out | std::ios_base::binary);
+	if (write_velocities) velocities.open(velocity_file.string(), std::ios_base::out | std::ios_base::binary);
+	if (!write_displacements && !write_velocities) return;
+
+	vector<double> reference(3 * nNodes);
+	d3plot.GatherReference(node_index, reference.data());
+
+	//States are gathered in parallel a batch at a time, then appended to the files in order, so the
+	//memory used does not grow with the length of the simulation
+	const size_t batch = 64;
+	size_t stride = 3 * nNodes;
+	vector<double> xyz(write_displacements ? batch * stride : 0);
+	vector<double> vxyz(write_velocities ? batch * stride : 0);
+	for (size_t first = 0; first < nStates; first += batch)
+	{
+		size_t count = std::min(batch, nStates - first);
+		ParallelFor(count, [&](size_t b, size_t e) {
+			for (size_t k = b; k < e; ++k)
+			{
+				double *x = write_displacements ? &xyz[k * stride] : nullptr;
+				double *v = write_velocities ? &vxyz[k * stride] : nullptr;
+				d3plot.GatherState(first + k, node_index, x, v);
+				if (x) for (size_t i = 0; i < stride; ++i) x[i] -= reference[i];
+			}
+		}, 1);
+
+		size_t bytes = count * stride * sizeof(double);
+		if (write_displacements) displacements.write(reinterpret_cast<char const*>(xyz.data()), bytes);
+		if (write_velocities) velocities.write(reinterpret_cast<char const*>(vxyz.data()), bytes);
+		Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN,
+			static_cast<long long>(bytes * (write_displacements + write_velocities)));
+		ProgressReporter::Get().Update("d3plot", static_cast<long long>(first + count), static_cast<long long>(nStates), base_name, false);
+	}
+}
+
+}
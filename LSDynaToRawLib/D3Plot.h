@@ -0,0 +1,101 @@
+// D3Plot.h : Reader for the state data of an LS-Dyna d3plot binary database family.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace d2r
+{
+
+//The files of a d3plot family in order: base_file, then base_file01, base_file02, ... for as long as they exist.
+//Throws if base_file does not exist.
+vector<fs::path> D3PlotFamily(fs::path const &base_file);
+
+//Memory maps d3plot, d3plot01, d3plot02, ... and locates every state in the family.  Only the nodal
+//coordinate and velocity blocks are read; element results are skipped over by size.
+//Single and double precision databases are recognized, in the byte order of the host.
+class D3Plot
+{
+public:
+	D3Plot(fs::path const &base_file);
+
+	size_t GetNumStates() const
+	{
+		return states.size();
+	}
+
+	size_t GetNumNodes() const
+	{
+		return static_cast<size_t>(numnp);
+	}
+
+	bool HasCoordinates() const
+	{
+		return iu != 0;
+	}
+
+	bool HasVelocities() const
+	{
+		return iv != 0;
+	}
+
+	double GetTime(size_t state) const;
+
+	//Index of each node of the given object in the nodal arrays of the database.  Throws if a node
+	//is not part of the database.
+	vector<size_t> MapNodes(Nodes const &nodes) const;
+
+	//Copies the undeformed coordinates of the given nodes from the geometry section, three values per node
+	void GatherReference(vector<size_t> const &node_index, double *xyz) const;
+
+	//Copies the coordinates and velocities of the given nodes in one state into xyz and vxyz,
+	//three values per node.  Either output may be null.
+	void GatherState(size_t state, vector<size_t> const &node_index, double *xyz, double *vxyz) const;
+
+private:
+	typedef boost::iostreams::mapped_file_source mapped_file;
+
+	long long Int(mapped_file const &f, size_t word) const;
+
+	double Real(mapped_file const &f, size_t word) const;
+
+	size_t Words(mapped_file const &f) const
+	{
+		return f.size() / word_size;
+	}
+
+	//Reads the control words and geometry of the first file; returns the word at which states begin
+	size_t ReadHeader();
+
+	struct StateLocation
+	{
+		size_t file;
+		size_t word;
+	};
+
+	vector<std::unique_ptr<mapped_file>>	files;
+	vector<StateLocation>				states;
+	vector<double>						reference; //undeformed coordinates, three per node
+	vector<long long>					user_ids; //node IDs in database order; empty if numbered from 1
+	size_t								word_size;
+	size_t								state_size;
+	size_t								ndim;
+	long long							numnp;
+	long long							nglbv;
+	long long							it;
+	long long							iu;
+	long long							iv;
+	long long							ia;
+};
+
+//Writes the time history of one part: <base_name>-times.txt with one time per state, and
+//<base_name>-displacements.bin and <base_name>-velocities.bin as arrays of doubles indexed by
+//[state][local node][x, y, z].  Displacements are measured from the d3plot geometry.  Local nodes
+//are in the order of part_nodes, which for an isolated part is the order Renumber_Nodes numbers them in.
+void OutputTimeHistory(string const &base_name, D3Plot const &d3plot, Nodes const &part_nodes, bool overwrite = false);
+
+}
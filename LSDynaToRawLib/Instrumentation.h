@@ -0,0 +1,308 @@
+// Instrumentation.h : Phase timers, work counters and progress reporting for --stats, --trace and --progress.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <iomanip>
+#include <sstream>
+
+namespace d2r
+{
+
+
+//Escapes a string for use inside a JSON string literal; control characters are dropped
+inline string JsonEscape(string const &s)
+{
+	string r;
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\') r += '\\';
+		if (static_cast<unsigned char>(c) < 0x20) continue;
+		r += c;
+	}
+	return r;
+}
+
+//Collects phase timings and work counters for --stats and --trace.  Everything is a no-op unless
+//Enable() has been called, so that the cost in a normal run is a single branch per call site.
+class Instrumentation
+{
+public:
+	typedef enum Counter_t
+	{
+		BYTES_READ = 0,
+		SYMBOLS_LEXED,
+		NODES,
+		ELEMENTS,
+		MAP_LOOKUPS,		//finds and inserts in the ID maps, counted where they are made
+		BYTES_WRITTEN,
+		NUM_COUNTERS
+	} Counter;
+
+	typedef std::chrono::steady_clock clock;
+
+	struct Event
+	{
+		string name;
+		int tid;
+		long long start_us;
+		long long duration_us;
+	};
+
+	static Instrumentation& Get()
+	{
+		static Instrumentation instance;
+		return instance;
+	}
+
+	void Enable() { enabled = true; }
+	bool IsEnabled() const { return enabled; }
+
+	void Count(Counter c, long long n = 1)
+	{
+		if (enabled) counters[c].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	long long GetCount(Counter c) const
+	{
+		return counters[c].load(std::memory_order_relaxed);
+	}
+
+	void Record(string const &name, clock::time_point start, clock::time_point stop)
+	{
+		if (!enabled) return;
+		Event ev;
+		ev.name = name;
+		ev.start_us = std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count();
+		ev.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+		std::lock_guard<std::mutex> lock(mutex);
+		ev.tid = ThreadNumber();
+		events.push_back(ev);
+	}
+
+	void PrintSummary(std::ostream &os) const
+	{
+		static const char *counter_names[NUM_COUNTERS] = {
+			"Bytes read", "Symbols lexed", "Nodes", "Elements", "Map lookups", "Bytes written"
+		};
+
+		//aggregate events by name, in order of first appearance
+		vector<string> names;
+		map<string, std::pair<int, long long>> totals;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto const &ev : events)
+			{
+				if (totals.count(ev.name) == 0) names.push_back(ev.name);
+				auto &t = totals[ev.name];
+				t.first += 1;
+				t.second += ev.duration_us;
+			}
+		}
+
+		os << endl << "Phase                              Calls      Time (ms)" << endl;
+		for (auto const &name : names)
+		{
+			auto const &t = totals.at(name);
+			os << std::left << std::setw(32) << name
+				<< std::right << std::setw(8) << t.first
+				<< std::setw(15) << std::fixed << std::setprecision(3) << t.second / 1000.0 << endl;
+		}
+		os << endl << "Counter                                         Value" << endl;
+		for (int c = 0; c < NUM_COUNTERS; ++c)
+		{
+			os << std::left << std::setw(32) << counter_names[c]
+				<< std::right << std::setw(21) << GetCount(static_cast<Counter>(c)) << endl;
+		}
+		os.unsetf(std::ios_base::floatfield);
+	}
+
+	//Writes the recorded events in the Chrome trace-event format (chrome://tracing, Perfetto), one track per thread
+	void WriteTrace(string const &file_name) const
+	{
+		std::ofstream f(file_name);
+		if (f.fail()) throw std::runtime_error("Could not open trace file " + file_name + " for writing.");
+		std::lock_guard<std::mutex> lock(mutex);
+		f << "{\"traceEvents\":[";
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			Event const &ev = events[i];
+			f << (i ? ",\n" : "\n")
+				<< "{\"name\":\"" << JsonEscape(ev.name) << "\",\"ph\":\"X\",\"pid\":1"
+				<< ",\"tid\":" << ev.tid
+				<< ",\"ts\":" << ev.start_us
+				<< ",\"dur\":" << ev.duration_us << "}";
+		}
+		f << "\n],\"otherData\":{";
+		static const char *counter_keys[NUM_COUNTERS] = {
+			"bytes_read", "symbols_lexed", "nodes", "elements", "map_lookups", "bytes_written"
+		};
+		for (int c = 0; c < NUM_COUNTERS; ++c)
+		{
+			f << (c ? "," : "") << "\"" << counter_keys[c] << "\":\"" << GetCount(static_cast<Counter>(c)) << "\"";
+		}
+		f << "}}" << endl;
+	}
+
+private:
+	Instrumentation()
+		: enabled(false)
+		, origin(clock::now())
+	{
+		for (auto &c : counters) c.store(0);
+	}
+
+	//small, stable thread numbers make nicer track names than hashed std::thread::ids; the caller holds the mutex
+	int ThreadNumber()
+	{
+		auto id = std::this_thread::get_id();
+		auto it = thread_numbers.find(id);
+		if (it != thread_numbers.end()) return it->second;
+		int n = static_cast<int>(thread_numbers.size()) + 1;
+		thread_numbers[id] = n;
+		return n;
+	}
+
+	bool enabled;
+	clock::time_point origin;
+	std::atomic<long long> counters[NUM_COUNTERS];
+	mutable std::mutex mutex;
+	vector<Event> events;
+	map<std::thread::id, int> thread_numbers;
+};
+
+//Records the lifetime of the enclosing scope as one trace event
+class ScopedTimer
+{
+public:
+	ScopedTimer(string const &name_)
+		: active(Instrumentation::Get().IsEnabled())
+	{
+		if (active) {
+			name = name_;
+			start = Instrumentation::clock::now();
+		}
+	}
+
+	~ScopedTimer()
+	{
+		if (active) Instrumentation::Get().Record(name, start, Instrumentation::clock::now());
+	}
+
+private:
+	bool active;
+	string name;
+	Instrumentation::clock::time_point start;
+};
+
+//Adds the lifetime of the enclosing scope to a running total, for work that is too fine grained to trace call by call
+class ScopedAccumulator
+{
+public:
+	ScopedAccumulator(Instrumentation::clock::duration &total_)
+		: total(total_)
+		, active(Instrumentation::Get().IsEnabled())
+	{
+		if (active) start = Instrumentation::clock::now();
+	}
+
+	~ScopedAccumulator()
+	{
+		if (active) total += Instrumentation::clock::now() - start;
+	}
+
+private:
+	Instrumentation::clock::duration &total;
+	bool active;
+	Instrumentation::clock::time_point start;
+};
+
+//Periodic progress output for long conversions, written to stderr as plain text or as one JSON object per line.
+//Reports are rate limited to one per interval, except that the last update of each phase is always shown.
+class ProgressReporter
+{
+public:
+	typedef enum Format_t
+	{
+		NONE = 0,
+		TEXT,
+		JSON
+	} Format;
+
+	typedef std::chrono::steady_clock clock;
+
+	static ProgressReporter& Get()
+	{
+		static ProgressReporter instance;
+		return instance;
+	}
+
+	void SetFormat(Format format_) { format = format_; }
+	bool IsEnabled() const { return format != NONE; }
+
+	//Starts the clock of a phase again, e.g. when the next input file is parsed
+	void Restart(string const &phase) { phases.erase(phase); }
+
+	//done and total are bytes when is_bytes is set (rate is shown in MB/s), otherwise a count of parts
+	void Update(string const &phase, long long done, long long total, string const &section, bool is_bytes)
+	{
+		if (format == NONE) return;
+
+		//phases may interleave (isolate and write alternate per part), so each keeps its own clock
+		clock::time_point now = clock::now();
+		auto it = phases.find(phase);
+		if (it == phases.end()) {
+			it = phases.insert(std::make_pair(phase, std::make_pair(now, now))).first;
+		}
+		clock::time_point &last_report = it->second.second;
+		if (done < total && now - last_report < interval) return;
+		last_report = now;
+
+		double elapsed = std::chrono::duration<double>(now - it->second.first).count();
+		double fraction = total > 0 ? static_cast<double>(done) / total : 1.0;
+		double rate = elapsed > 0 ? done / elapsed : 0.0;
+		double eta = (rate > 0 && done < total) ? (total - done) / rate : 0.0;
+		if (is_bytes) rate /= 1024.0 * 1024.0;
+
+		std::ostringstream os;
+		os << std::fixed;
+		if (format == JSON) {
+			os << "{\"phase\":\"" << phase << "\""
+				<< ",\"done\":" << done
+				<< ",\"total\":" << total
+				<< ",\"unit\":\"" << (is_bytes ? "bytes" : "parts") << "\""
+				<< std::setprecision(1) << ",\"percent\":" << 100.0 * fraction
+				<< std::setprecision(3) << ",\"rate\":" << rate
+				<< ",\"rate_unit\":\"" << (is_bytes ? "MB/s" : "parts/s") << "\""
+				<< ",\"section\":\"" << JsonEscape(section) << "\""
+				<< std::setprecision(1) << ",\"elapsed_s\":" << elapsed
+				<< ",\"eta_s\":" << eta << "}";
+		}
+		else {
+			os << "[" << phase << "] "
+				<< std::setprecision(1) << std::setw(5) << 100.0 * fraction << "%  "
+				<< std::setprecision(2) << rate << (is_bytes ? " MB/s" : " parts/s")
+				<< "  " << section
+				<< std::setprecision(0) << "  ETA " << eta << " s";
+		}
+		std::cerr << os.str() << endl;
+	}
+
+private:
+	ProgressReporter()
+		: format(NONE)
+		, interval(std::chrono::seconds(1))
+	{}
+
+	Format format;
+	clock::duration interval;
+	map<string, std::pair<clock::time_point, clock::time_point>> phases; //phase -> (start, last report)
+};
+
+}
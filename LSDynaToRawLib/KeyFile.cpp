@@ -0,0 +1,766 @@
+// KeyFile.cpp : Parser that reads the nodes, elements and parts from a set of LS-Dyna keyfiles.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "KeyFile.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace d2r
+{
+
+std::locale loc("");
+
+KeyFile::KeyFile(string name)
+	: convert_time(Instrumentation::clock::duration::zero())
+	, add_element_time(Instrumentation::clock::duration::zero())
+	, scan_time(Instrumentation::clock::duration::zero())
+	, symbol_count(0)
+	, node_count(0)
+	, element_count(0)
+	, map_lookups(0)
+	, set_kind(NODE_SET)
+	, set_generate(false)
+	, range_pending(false)
+	, range_begin(0)
+	, current_set(nullptr)
+	, verbose(true)
+	, legacy_lexer(false)
+{
+	infile = fs::canonical(fs::path(name));
+	if (!fs::is_regular_file(infile))
+	{
+		throw std::invalid_argument("Input file must be a regular file and not a directory or symlink.");
+	}
+
+	Parse();
+}
+
+void KeyFile::Append(string name)
+{
+	infile = fs::canonical(fs::path(name));
+	if (!fs::is_regular_file(infile))
+	{
+		throw std::invalid_argument("Input file must be a regular file and not a directory or symlink.");
+	}
+
+	Parse();
+}
+
+void KeyFile::Append(KeyFile const &other)
+{
+	Replay(other.obj.nodes, other.obj.elements, other.part_names, other.sets);
+}
+
+void KeyFile::Append(string name, fs::path const &cache_file)
+{
+	KeyFile single;
+	single.verbose = verbose;
+	single.legacy_lexer = legacy_lexer;
+	single.Append(name);
+	single.Save(cache_file);
+	Append(single);
+}
+
+namespace
+{
+	const char CACHE_MAGIC[8] = { 'D', '2', 'R', 'C', 'A', 'C', 'H', '2' };
+
+	//caches written before sets were read; they are restored without sets
+	const char CACHE_MAGIC_V1[8] = { 'D', '2', 'R', 'C', 'A', 'C', 'H', '1' };
+
+	template <typename T>
+	void WriteColumn(std::ostream &f, vector<T> const &v)
+	{
+		unsigned long long n = v.size();
+		f.write(reinterpret_cast<char const*>(&n), sizeof(n));
+		f.write(reinterpret_cast<char const*>(v.data()), n * sizeof(T));
+	}
+
+	template <typename T>
+	void ReadColumn(std::istream &f, vector<T> &v)
+	{
+		unsigned long long n = 0;
+		f.read(reinterpret_cast<char*>(&n), sizeof(n));
+		if (!f) throw std::runtime_error("The parse cache is truncated.");
+		v.resize(static_cast<size_t>(n));
+		f.read(reinterpret_cast<char*>(v.data()), n * sizeof(T));
+		if (!f) throw std::runtime_error("The parse cache is truncated.");
+	}
+}
+
+void KeyFile::Save(fs::path const &cache_file) const
+{
+	ScopedTimer timer("SaveCache");
+	std::ofstream f(cache_file.string(), std::ios_base::out | std::ios_base::binary);
+	if (f.fail()) throw std::runtime_error("Could not write the parse cache " + cache_file.string());
+	f.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	WriteColumn(f, obj.nodes.nids);
+	WriteColumn(f, obj.nodes.x);
+	WriteColumn(f, obj.nodes.y);
+	WriteColumn(f, obj.nodes.z);
+	WriteColumn(f, obj.elements.eids);
+	WriteColumn(f, obj.elements.pids);
+	vector<int> const *columns[8] = { &obj.elements.n1, &obj.elements.n2, &obj.elements.n3, &obj.elements.n4,
+		&obj.elements.n5, &obj.elements.n6, &obj.elements.n7, &obj.elements.n8 };
+	for (int k = 0; k < 8; ++k) WriteColumn(f, *columns[k]);
+
+	vector<int> pids;
+	vector<char> names; //NUL separated, in the order of pids
+	for (auto it = begin(part_names); it != end(part_names); ++it)
+	{
+		pids.push_back(it->first);
+		names.insert(names.end(), it->second.begin(), it->second.end());
+		names.push_back('\0');
+	}
+	WriteColumn(f, pids);
+	WriteColumn(f, names);
+
+	vector<int> set_kinds, set_ids;
+	vector<char> set_titles; //NUL separated, in the order of set_ids
+	for (auto it = begin(sets); it != end(sets); ++it)
+	{
+		set_kinds.push_back(static_cast<int>(it->second.kind));
+		set_ids.push_back(it->second.sid);
+		set_titles.insert(set_titles.end(), it->second.title.begin(), it->second.title.end());
+		set_titles.push_back('\0');
+	}
+	WriteColumn(f, set_kinds);
+	WriteColumn(f, set_ids);
+	WriteColumn(f, set_titles);
+	for (auto it = begin(sets); it != end(sets); ++it) WriteColumn(f, it->second.members.ToVector());
+}
+
+void KeyFile::Restore(fs::path const &cache_file)
+{
+	ScopedTimer timer("RestoreCache");
+	std::ifstream f(cache_file.string(), std::ios_base::in | std::ios_base::binary);
+	char magic[sizeof(CACHE_MAGIC)];
+	if (!f.read(magic, sizeof(magic)))
+		throw std::runtime_error(cache_file.string() + " is not a parse cache.");
+	bool has_sets = std::equal(magic, magic + sizeof(magic), CACHE_MAGIC);
+	if (!has_sets && !std::equal(magic, magic + sizeof(magic), CACHE_MAGIC_V1))
+		throw std::runtime_error(cache_file.string() + " is not a parse cache.");
+
+	Nodes nodes;
+	Elements elements;
+	ReadColumn(f, nodes.nids);
+	ReadColumn(f, nodes.x);
+	ReadColumn(f, nodes.y);
+	ReadColumn(f, nodes.z);
+	ReadColumn(f, elements.eids);
+	ReadColumn(f, elements.pids);
+	vector<int> *columns[8] = { &elements.n1, &elements.n2, &elements.n3, &elements.n4,
+		&elements.n5, &elements.n6, &elements.n7, &elements.n8 };
+	for (int k = 0; k < 8; ++k) ReadColumn(f, *columns[k]);
+
+	vector<int> pids;
+	vector<char> names;
+	ReadColumn(f, pids);
+	ReadColumn(f, names);
+	std::map<int, string> part_names_;
+	size_t pos = 0;
+	for (size_t i = 0; i < pids.size() && pos < names.size(); ++i)
+	{
+		string name(&names[pos]);
+		pos += name.size() + 1;
+		part_names_[pids[i]] = name;
+	}
+
+	SetMap sets_;
+	if (has_sets) {
+		vector<int> set_kinds, set_ids;
+		vector<char> set_titles;
+		ReadColumn(f, set_kinds);
+		ReadColumn(f, set_ids);
+		ReadColumn(f, set_titles);
+		pos = 0;
+		for (size_t i = 0; i < set_ids.size() && i < set_kinds.size() && pos < set_titles.size(); ++i)
+		{
+			EntitySet s;
+			s.kind = static_cast<SetKind>(set_kinds[i]);
+			s.sid = set_ids[i];
+			s.title = string(&set_titles[pos]);
+			pos += s.title.size() + 1;
+			vector<int> members;
+			ReadColumn(f, members);
+			for (auto it = members.begin(); it != members.end(); ++it) s.members.Add(*it);
+			sets_[std::make_pair(set_kinds[i], set_ids[i])] = s;
+		}
+	}
+
+	Instrumentation::Get().Count(Instrumentation::BYTES_READ, static_cast<long long>(fs::file_size(cache_file)));
+	Replay(nodes, elements, part_names_, sets_);
+	if (verbose) cout << "Restored " << nodes.nids.size() << " nodes and " << elements.eids.size()
+		<< " elements from " << cache_file.string() << endl;
+}
+
+void KeyFile::Replay(Nodes const &nodes, Elements const &elements, std::map<int, string> const &names, SetMap const &more_sets)
+{
+	long long lookups_before = map_lookups;
+	for (size_t j = 0; j < nodes.nids.size(); ++j)
+	{
+		node_count += 1;
+		StoreNode(static_cast<int>(nodes.nids[j]), nodes.x[j], nodes.y[j], nodes.z[j]);
+	}
+	for (size_t j = 0; j < elements.eids.size(); ++j)
+	{
+		int nids[8] = { elements.n1[j], elements.n2[j], elements.n3[j], elements.n4[j],
+			elements.n5[j], elements.n6[j], elements.n7[j], elements.n8[j] };
+		element_count += 1;
+		StoreElement(elements.eids[j], elements.pids[j], nids);
+	}
+	for (auto it = begin(names); it != end(names); ++it)
+		part_names[it->first] = it->second;
+	map_lookups += static_cast<long long>(names.size());
+	MergeSets(sets, more_sets);
+	Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS, map_lookups - lookups_before);
+}
+
+void KeyFile::Parse()
+{
+	if (verbose) cout << "Reading from " << infile.string() << endl;
+	ScopedTimer timer("Parse");
+	auto parse_start = Instrumentation::clock::now();
+	long long nodes_before = node_count;
+	long long elements_before = element_count;
+	long long lookups_before = map_lookups;
+	convert_time = add_element_time = scan_time = Instrumentation::clock::duration::zero();
+	symbol_count = 0;
+	std::ifstream f;
+	f.open(infile.make_preferred().string(), legacy_lexer ? std::ios_base::in : std::ios_base::in | std::ios_base::binary);
+	if (f.fail()) throw std::runtime_error("The file exists, but it could not be opened.");
+	ProgressReporter::Get().Restart("parse");
+
+	if (legacy_lexer) ParseSymbols(f);
+	else ParseIndexed(f);
+
+	if (verbose) PrintParseSummary();
+
+	Instrumentation &I = Instrumentation::Get();
+	if (I.IsEnabled())
+	{
+		long long nNodes = node_count - nodes_before;
+		long long nElements = element_count - elements_before;
+		I.Count(Instrumentation::BYTES_READ, static_cast<long long>(fs::file_size(infile)));
+		I.Count(Instrumentation::SYMBOLS_LEXED, symbol_count);
+		I.Count(Instrumentation::NODES, nNodes);
+		I.Count(Instrumentation::ELEMENTS, nElements);
+		I.Count(Instrumentation::MAP_LOOKUPS, map_lookups - lookups_before);
+
+		//the fine grained work is reported as one slice per kind, anchored at the start of the parse
+		if (legacy_lexer) {
+			I.Record("Lexing (cumulative)", parse_start, parse_start + scan_time);
+			I.Record("lexical_cast (cumulative)", parse_start, parse_start + convert_time);
+		}
+		else {
+			I.Record("Structural index (cumulative)", parse_start, parse_start + scan_time);
+			I.Record("Card parsing (cumulative)", parse_start, parse_start + convert_time);
+		}
+		I.Record("AddElement (cumulative)", parse_start, parse_start + add_element_time);
+	}
+}
+
+void KeyFile::ParseSymbols(std::ifstream &f)
+{
+	lexer = std::make_unique<KeyFileLexer>(f);
+	ProgressReporter &progress = ProgressReporter::Get();
+	long long file_size = static_cast<long long>(fs::file_size(infile));
+	string section;
+	int nIterations = 0;
+	LexerSymbol S = lexer->NextSymbol();
+	int state = 0;
+	while (S.type != LexerSymbol::END_OF_FILE)
+	{
+		switch (state) {
+		case 0:
+			if (S.type == LexerSymbol::ASTERISK) state = 1;
+			break;
+		case 1:
+			if (S.type == LexerSymbol::WORD) section = S.symbol;
+			if (S.type == LexerSymbol::WORD && !strcmpi(S.symbol.c_str(), "NODE")) { state = 2; }
+			else if (S.type == LexerSymbol::WORD && !strcmpi(S.symbol.c_str(), "ELEMENT_SOLID")) { state = 3; }
+			else if (S.type == LexerSymbol::WORD && !strcmpi(S.symbol.c_str(), "ELEMENT_SHELL")) { state = 3; }
+			else if (S.type == LexerSymbol::WORD && !strcmpi(S.symbol.c_str(), "ELEMENT_BEAM")) { state = 3; }
+			else if (S.type == LexerSymbol::WORD && !strcmpi(S.symbol.c_str(), "PART")) { state = 4; }
+			else if (S.type == LexerSymbol::WORD && !strcmpi(S.symbol.c_str(), "PART_INERTIA")) { state = 4; }
+			else if (S.type == LexerSymbol::WORD) { state = StartSet(S.symbol); }
+			else { state = 0; }
+			break;
+		case 2: //NODE
+			if (S.type == LexerSymbol::WHITESPACE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NUMBER) {
+				AcceptNode();
+			} else if (S.type == LexerSymbol::NEWLINE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::ASTERISK) { state = 1; }
+			else { state = 0; }
+			
+			break;
+		case 3: //ELEMENT_SOLID or ELEMENT_BEAM or ELEMENT_SHELL
+			if (S.type == LexerSymbol::WHITESPACE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NUMBER) {
+				AcceptElement();
+			}
+			else if (S.type == LexerSymbol::NEWLINE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::ASTERISK) { state = 1; }
+			else { state = 0; }
+
+			break;
+		case 4: //PART
+			if (S.type == LexerSymbol::WHITESPACE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NEWLINE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::ASTERISK) { state = 1; }
+			else if (S.type == LexerSymbol::WORD) {
+				AcceptPart();
+			}
+			else { state = 0; }
+			break;
+		case 6: //SET, waiting for the title
+			if (S.type == LexerSymbol::WHITESPACE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NEWLINE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::ASTERISK) { state = 1; }
+			else {
+				AcceptSetTitle();
+				state = 7;
+			}
+			break;
+		case 7: //SET, the first number on the first card is the set ID
+			if (S.type == LexerSymbol::WHITESPACE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NEWLINE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NUMBER) {
+				OpenSet(Convert<int>(S.symbol));
+				state = 9;
+			}
+			else if (S.type == LexerSymbol::ASTERISK) { state = 1; }
+			else { state = 0; }
+			break;
+		case 8: //SET, the members
+			if (S.type == LexerSymbol::WHITESPACE || S.type == LexerSymbol::COMMA) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::NUMBER) {
+				AddSetMember(static_cast<int>(Convert<double>(S.symbol)));
+			}
+			else if (S.type == LexerSymbol::NEWLINE) { /*Do nothing*/ }
+			else if (S.type == LexerSymbol::ASTERISK) { state = 1; }
+			else { state = 0; }
+			break;
+		case 9: //SET, the rest of the first card (solver, attributes) is skipped
+			if (S.type == LexerSymbol::NEWLINE) { state = 8; }
+			break;
+		}
+		
+		S = lexer->NextSymbol();
+
+		//asking the stream for its position is not free, so only do it every few hundred cards
+		if (progress.IsEnabled() && (++nIterations & 0xff) == 0 && S.type != LexerSymbol::END_OF_FILE) {
+			progress.Update("parse", static_cast<long long>(f.tellg()), file_size, section, true);
+		}
+	}
+	progress.Update("parse", file_size, file_size, section, true);
+
+	symbol_count = lexer->GetSymbolCount();
+	scan_time = lexer->GetLexTime();
+	lexer.reset();
+}
+
+namespace
+{
+	inline bool StartsNumber(char c)
+	{
+		return (c >= '0' && c <= '9') || c == '-';
+	}
+
+	//The whole token must be consumed, as lexical_cast requires
+	inline bool ParseInt(char const *b, char const *e, int &value)
+	{
+		char *stop;
+		value = static_cast<int>(std::strtol(b, &stop, 10));
+		return stop == e;
+	}
+
+	inline bool ParseDouble(char const *b, char const *e, double &value)
+	{
+		char *stop;
+		value = std::strtod(b, &stop);
+		return stop == e;
+	}
+
+	std::runtime_error MalformedCard(long long line)
+	{
+		return std::runtime_error(
+			string("Line ")
+			+ boost::lexical_cast<string>(line)
+			+ string(": Could not parse file: element list appears to be malformed.")
+		);
+	}
+}
+
+void KeyFile::ParseIndexed(std::ifstream &f)
+{
+	ProgressReporter &progress = ProgressReporter::Get();
+	long long file_size = static_cast<long long>(fs::file_size(infile));
+	string section;
+
+	//The file is read in chunks of whole lines, so that a card never straddles two structural indices.
+	//The tail of a chunk after its last newline is carried over to the front of the next one.
+	const size_t chunk_size = size_t(16) << 20;
+	vector<char> buffer(chunk_size + 64);
+	size_t filled = 0;
+	bool eof = false;
+	long long consumed = 0;
+	long long line = 0;
+	int state = 0;
+	StructuralIndex index;
+
+	while (true)
+	{
+		if (!eof) {
+			if (buffer.size() < filled + chunk_size + 64) buffer.resize(filled + chunk_size + 64);
+			f.read(buffer.data() + filled, chunk_size);
+			size_t got = static_cast<size_t>(f.gcount());
+			filled += got;
+			eof = got < chunk_size;
+		}
+
+		size_t length;
+		if (eof) {
+			if (filled == 0) break;
+			if (buffer[filled - 1] != '\n') buffer[filled++] = '\n';
+			length = filled;
+		}
+		else {
+			size_t last = filled;
+			while (last > 0 && buffer[last - 1] != '\n') --last;
+			if (last == 0) continue; //a single line longer than the chunk; keep reading
+			length = last;
+		}
+
+		{
+			ScopedAccumulator t(scan_time);
+			index.Build(buffer.data(), length);
+		}
+		symbol_count += index.GetTokenCount();
+
+		ScopedAccumulator t(convert_time);
+		char const *b, *e;
+		do
+		{
+			++line;
+			char const *lb = index.LineBegin();
+			if (*lb == '$') continue;
+			if (*lb == '*') {
+				char const *kw = lb + 1;
+				char const *kw_end = kw;
+				while (!IsSeparator(*kw_end)) ++kw_end;
+				if (kw != kw_end && !StartsNumber(*kw)) section.assign(kw, kw_end);
+
+				string keyword(kw, kw_end);
+				if (!strcmpi(keyword.c_str(), "NODE")) { state = 2; }
+				else if (!strcmpi(keyword.c_str(), "ELEMENT_SOLID")) { state = 3; }
+				else if (!strcmpi(keyword.c_str(), "ELEMENT_SHELL")) { state = 3; }
+				else if (!strcmpi(keyword.c_str(), "ELEMENT_BEAM")) { state = 3; }
+				else if (!strcmpi(keyword.c_str(), "PART")) { state = 4; }
+				else if (!strcmpi(keyword.c_str(), "PART_INERTIA")) { state = 4; }
+				else { state = StartSet(keyword); }
+				continue;
+			}
+			if (state == 0 || !index.NextToken(b, e)) continue;
+
+			switch (state) {
+			case 2: //NODE
+			{
+				if (!StartsNumber(*b)) { state = 0; break; }
+				int nid;
+				double xyz[3];
+				if (!ParseInt(b, e, nid)) throw MalformedCard(line);
+				for (int i = 0; i < 3; ++i) {
+					if (!index.NextToken(b, e) || !ParseDouble(b, e, xyz[i])) throw MalformedCard(line);
+				}
+				node_count += 1;
+				StoreNode(nid, xyz[0], xyz[1], xyz[2]);
+				break;
+			}
+			case 3: //ELEMENT_SOLID or ELEMENT_BEAM or ELEMENT_SHELL
+			{
+				if (!StartsNumber(*b)) { state = 0; break; }
+				int eid, pid;
+				if (!ParseInt(b, e, eid)) throw MalformedCard(line);
+				if (!index.NextToken(b, e) || !ParseInt(b, e, pid)) throw MalformedCard(line);
+
+				//shell and beam cards may stop short of eight nodes; the missing corners stay 0
+				int nids[8]; std::fill(std::begin(nids), std::end(nids), 0);
+				for (int i = 0; i < 8 && index.NextToken(b, e); ++i) {
+					double n;
+					if (!ParseDouble(b, e, n)) throw MalformedCard(line);
+					nids[i] = static_cast<int>(n);
+				}
+				element_count += 1;
+				StoreElement(eid, pid, nids);
+				break;
+			}
+			case 4: //PART, waiting for the title
+				if (StartsNumber(*b)) { state = 0; break; }
+				pending_part_name.assign(b, index.LineEnd());
+				if (!pending_part_name.empty() && pending_part_name.back() == '\r') pending_part_name.pop_back();
+				state = 5;
+				break;
+			case 5: //PART, the next number that we see is the part ID
+				do {
+					int pid;
+					if (StartsNumber(*b) && ParseInt(b, b + std::strspn(b, "-0123456789"), pid)) {
+						part_names[pid] = pending_part_name;
+						map_lookups += 1;
+						state = 4;
+						//the rest of the card (section, material...) ends the part
+						if (index.NextToken(b, e)) {
+							if (StartsNumber(*b)) state = 0;
+							else {
+								pending_part_name.assign(b, index.LineEnd());
+								if (!pending_part_name.empty() && pending_part_name.back() == '\r') pending_part_name.pop_back();
+								state = 5;
+							}
+						}
+						break;
+					}
+				} while (index.NextToken(b, e));
+				break;
+			case 6: //SET, the title
+				pending_set_title.assign(b, index.LineEnd());
+				while (!pending_set_title.empty() && IsSeparator(pending_set_title.back())) pending_set_title.pop_back();
+				state = 7;
+				break;
+			case 7: //SET, the first number on the first card is the set ID; the rest of the card is skipped
+			{
+				if (!StartsNumber(*b)) { state = 0; break; }
+				int sid;
+				if (!ParseInt(b, e, sid)) throw MalformedCard(line);
+				OpenSet(sid);
+				state = 8;
+				break;
+			}
+			case 8: //SET, the members
+				do {
+					double id;
+					if (!StartsNumber(*b)) { state = 0; break; }
+					if (!ParseDouble(b, e, id)) throw MalformedCard(line);
+					AddSetMember(static_cast<int>(id));
+				} while (index.NextToken(b, e));
+				break;
+			}
+		} while (index.NextLine());
+
+		consumed += static_cast<long long>(length);
+		std::copy(buffer.begin() + length, buffer.begin() + filled, buffer.begin());
+		filled -= length;
+		progress.Update("parse", std::min(consumed, file_size), file_size, section, true);
+	}
+	progress.Update("parse", file_size, file_size, section, true);
+}
+
+void KeyFile::PrintParseSummary()
+{
+	cout << "Total number of nodes: " << obj.node_index.size() << endl;
+	cout << "Total number of elements: " << obj.element_index.size() << endl;
+
+	cout << "Parts with elements found: " << endl;
+	for (auto it = begin(parts); it != end(parts); ++it)
+	{
+		//look the name up without inserting, since a part may be named in a file that is appended later
+		auto name = part_names.find(it->first);
+		cout << "Part: " << (name == part_names.end() ? string() : name->second) << endl;
+	}
+
+	if (!sets.empty())
+	{
+		int counts[3] = { 0, 0, 0 };
+		for (auto it = begin(sets); it != end(sets); ++it) ++counts[it->second.kind];
+		cout << "Sets found: " << counts[NODE_SET] << " node, " << counts[PART_SET] << " part, " << counts[SOLID_SET] << " solid" << endl;
+	}
+}
+
+void KeyFile::StoreElement(int eid, int pid, int const (&nids)[8])
+{
+	ScopedAccumulator timer(add_element_time);
+	//the element index holds every element ID read so far, so duplicates are found without AddElement's
+	//linear search of the ID column
+	if (!obj.element_index.insert(std::make_pair(eid, (int)obj.elements.eids.size())).second) {
+		throw std::runtime_error("Found two elements with the same element id");
+	}
+	Elements *targets[2] = { &obj.elements, &parts[pid] };
+	for (Elements *E : targets)
+	{
+		E->eids.push_back(eid);
+		E->pids.push_back(pid);
+		E->n1.push_back(nids[0]);
+		E->n2.push_back(nids[1]);
+		E->n3.push_back(nids[2]);
+		E->n4.push_back(nids[3]);
+		E->n5.push_back(nids[4]);
+		E->n6.push_back(nids[5]);
+		E->n7.push_back(nids[6]);
+		E->n8.push_back(nids[7]);
+	}
+	map_lookups += 2;
+}
+
+int KeyFile::StartSet(string const &keyword)
+{
+	bool titled;
+	if (!ParseSetKeyword(keyword, set_kind, set_generate, titled)) return 0;
+	pending_set_title.clear();
+	current_set = nullptr;
+	return titled ? 6 : 7;
+}
+
+void KeyFile::OpenSet(int sid)
+{
+	EntitySet &s = sets[std::make_pair(static_cast<int>(set_kind), sid)];
+	map_lookups += 1;
+	s.kind = set_kind;
+	s.sid = sid;
+	if (!pending_set_title.empty()) s.title = pending_set_title;
+	current_set = &s;
+	range_pending = false;
+}
+
+void KeyFile::AddSetMember(int id)
+{
+	if (!set_generate) current_set->members.Add(id);
+	else if (!range_pending) {
+		range_begin = id;
+		range_pending = true;
+	}
+	else {
+		current_set->members.AddRange(range_begin, id);
+		range_pending = false;
+	}
+}
+
+void KeyFile::AcceptSetTitle()
+{
+	pending_set_title = lexer->GetCurrentSymbol().symbol;
+	LexerSymbol S;
+	while ((S = lexer->NextSymbol()).type != LexerSymbol::NEWLINE && S.type != LexerSymbol::END_OF_FILE)
+	{
+		pending_set_title += S.symbol;
+	}
+	while (!pending_set_title.empty() && IsSeparator(pending_set_title.back())) pending_set_title.pop_back();
+}
+
+void KeyFile::AcceptPart()
+{
+	string part_name = lexer->GetCurrentSymbol().symbol;
+	LexerSymbol S;
+	while ((S = lexer->NextSymbol()).type != LexerSymbol::NEWLINE)
+	{
+		part_name += S.symbol;
+	}
+
+	//the next number that we see is the part ID
+	while ((S = lexer->NextSymbol()).type != LexerSymbol::NUMBER)
+	{}
+
+	int pid = Convert<int>(S.symbol);
+	part_names[pid] = part_name;
+	map_lookups += 1;
+
+}
+
+void KeyFile::AcceptNode()
+{
+	int nid = Convert<int>(lexer->GetCurrentSymbol().symbol);
+
+	LexerSymbol S = lexer->NextSymbol();
+	if (!(S.type == LexerSymbol::WHITESPACE || S.type == LexerSymbol::COMMA)) {
+		throw std::runtime_error(
+			string("Line ")
+			+ boost::lexical_cast<string>(lexer->GetCurrentLine())
+			+ string(": Could not parse file: element list appears to be malformed.")
+		);
+	}
+	S = lexer->NextSymbol();
+	double x = Convert<double>(S.symbol);
+
+	S = lexer->NextSymbol();
+	if (!(S.type == LexerSymbol::WHITESPACE || S.type == LexerSymbol::COMMA)) {
+		throw std::runtime_error(
+			string("Line ")
+			+ boost::lexical_cast<string>(lexer->GetCurrentLine())
+			+ string(": Could not parse file: element list appears to be malformed.")
+		);
+	}
+	S = lexer->NextSymbol();
+	double y = Convert<double>(S.symbol);
+
+	S = lexer->NextSymbol();
+	if (!(S.type == LexerSymbol::WHITESPACE || S.type == LexerSymbol::COMMA)) {
+		throw std::runtime_error(
+			string("Line ")
+			+ boost::lexical_cast<string>(lexer->GetCurrentLine())
+			+ string(": Could not parse file: element list appears to be malformed.")
+		);
+	}
+	S = lexer->NextSymbol();
+	double z = Convert<double>(S.symbol);
+
+	while ((S = lexer->NextSymbol()).type != LexerSymbol::NEWLINE) {}
+
+	//Now add the node
+	node_count += 1;
+	StoreNode(nid, x, y, z);
+
+}
+
+void KeyFile::AcceptElement()
+{
+	int eid = Convert<int>(lexer->GetCurrentSymbol().symbol);
+
+	LexerSymbol S = lexer->NextSymbol();
+	if (!(S.type == LexerSymbol::WHITESPACE || S.type == LexerSymbol::COMMA)) {
+		throw std::runtime_error(
+			string("Line ")
+			+ boost::lexical_cast<string>(lexer->GetCurrentLine())
+			+ string(": Could not parse file: element list appears to be malformed.")
+		);
+	}
+
+	S = lexer->NextSymbol();
+	if (S.type != LexerSymbol::NUMBER) {
+		throw std::runtime_error(
+			string("Line ")
+			+ boost::lexical_cast<string>(lexer->GetCurrentLine())
+			+ string(": Could not parse file: element list appears to be malformed.")
+		);
+	}
+	int pid = Convert<int>(S.symbol);
+
+	int nids[8]; std::fill(begin(nids), end(nids), 0);
+	//Read in up to 8 nodes; shell cards may end after four, and the missing nodes are 0
+	for (int i = 0; i < 8; ++i)
+	{
+		S = lexer->NextSymbol();
+		if (S.type == LexerSymbol::NEWLINE) break;
+		if (!(S.type == LexerSymbol::WHITESPACE || S.type == LexerSymbol::COMMA)) {
+			throw std::runtime_error(
+				string("Line ")
+				+ boost::lexical_cast<string>(lexer->GetCurrentLine())
+				+ string(": Could not parse file: element list appears to be malformed.")
+			);
+		}
+		S = lexer->NextSymbol();
+		if (S.type == LexerSymbol::NEWLINE) break;
+		if (S.type != LexerSymbol::NUMBER) {
+			throw std::runtime_error(
+				string("Line ")
+				+boost::lexical_cast<string>(lexer->GetCurrentLine())
+				+ string(": Could not parse file: element list appears to be malformed.")
+			);
+		}
+		nids[i] = Convert<double>(S.symbol);
+	}
+
+	//Now add the element
+	element_count += 1;
+	StoreElement(eid, pid, nids);
+}
+
+}
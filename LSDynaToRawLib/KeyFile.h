@@ -0,0 +1,184 @@
+// KeyFile.h : Parser that reads the nodes, elements and parts from a set of LS-Dyna keyfiles.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include "KeyFileLexer.h"
+#include "StructuralIndex.h"
+#include "Sets.h"
+#include "Instrumentation.h"
+#include <boost/lexical_cast.hpp>
+
+namespace d2r
+{
+
+class KeyFile
+{
+	typedef string string;
+public:
+	KeyFile(string name);
+
+	KeyFile()
+		: convert_time(Instrumentation::clock::duration::zero())
+		, add_element_time(Instrumentation::clock::duration::zero())
+		, scan_time(Instrumentation::clock::duration::zero())
+		, symbol_count(0)
+		, node_count(0)
+		, element_count(0)
+		, map_lookups(0)
+		, set_kind(NODE_SET)
+		, set_generate(false)
+		, range_pending(false)
+		, range_begin(0)
+		, current_set(nullptr)
+		, verbose(true)
+		, legacy_lexer(false)
+	{}
+
+	virtual ~KeyFile() {}
+
+	void Append(string name);
+
+	//Adds everything read by another KeyFile, in the order it was read, as though its files had been appended
+	void Append(KeyFile const &other);
+
+	//Appends a keyfile and also saves what was read from it to cache_file, so that a later Restore of
+	//the cache can stand in for parsing the file again
+	void Append(string name, fs::path const &cache_file);
+
+	//Appends the contents of a file written by Save
+	void Restore(fs::path const &cache_file);
+
+	//Writes the nodes, elements, part names and sets read so far in a binary form that Restore reads back
+	void Save(fs::path const &cache_file) const;
+
+	//Prints progress of the parse to cout; on by default
+	void SetVerbose(bool verbose_)
+	{
+		verbose = verbose_;
+	}
+
+	//Reads the files with the original character-at-a-time lexer instead of the structural index
+	void SetLegacyLexer(bool legacy_lexer_)
+	{
+		legacy_lexer = legacy_lexer_;
+	}
+
+	std::map<int, Elements> const & GetParts() const
+	{
+		return parts;
+	}
+
+	std::map<int, string> const & GetPartNames() const
+	{
+		return part_names;
+	}
+
+	FiniteElementObject const & GetObjects() const
+	{
+		return obj;
+	}
+
+	//Moves the nodes and elements out, leaving the KeyFile without any; for a caller that is done with the KeyFile
+	FiniteElementObject ReleaseObjects()
+	{
+		FiniteElementObject released;
+		std::swap(released, obj);
+		return released;
+	}
+
+	//The node, part and solid sets read from *SET_NODE, *SET_PART and *SET_SOLID
+	SetMap const & GetSets() const
+	{
+		return sets;
+	}
+
+
+protected:
+	void Parse();
+
+	void ParseSymbols(std::ifstream &f);
+
+	void ParseIndexed(std::ifstream &f);
+
+	virtual void PrintParseSummary();
+
+	//Called for every node card; the default keeps the node in the global object
+	virtual void StoreNode(int nid, double x, double y, double z)
+	{
+		obj.nodes.AddNode(nid,
+			make_tuple(x, y, z));
+		obj.node_index[nid] = (int)obj.nodes.nids.size() - 1;
+		map_lookups += 1;
+	}
+
+	//Called for every element card; the default keeps the element in the global object and in its part
+	virtual void StoreElement(int eid, int pid, int const (&nids)[8]);
+
+	template <typename T>
+	T Convert(string const &symbol)
+	{
+		ScopedAccumulator timer(convert_time);
+		return boost::lexical_cast<T>(symbol);
+	}
+
+	//Passes nodes and elements to StoreNode and StoreElement as though they had just been parsed
+	void Replay(Nodes const &nodes, Elements const &elements, std::map<int, string> const &names, SetMap const &more_sets);
+
+	//Returns the parser state for the first card of a set keyword, or 0 if the keyword is not one that is read
+	int StartSet(string const &keyword);
+
+	//Called with the ID on the first card of a set
+	void OpenSet(int sid);
+
+	//Called for every ID on the following cards; _GENERATE sets take the IDs in pairs, as ranges
+	void AddSetMember(int id);
+
+	void AcceptSetTitle();
+
+	void AcceptPart();
+
+	void AcceptNode();
+
+	void AcceptElement();
+
+
+private:
+	fs::path						infile;
+	std::unique_ptr<KeyFileLexer>	lexer;
+	FiniteElementObject				obj;
+	std::map<int, string>			part_names;
+	std::map<int, Elements >		parts;
+	SetMap							sets;
+	Instrumentation::clock::duration	convert_time;
+	Instrumentation::clock::duration	add_element_time;
+	Instrumentation::clock::duration	scan_time;
+	long long						symbol_count;
+	long long						node_count;
+	long long						element_count;
+	long long						map_lookups; //inserts into the node, element, part and set maps
+	string							pending_part_name;
+	string							pending_set_title;
+	SetKind							set_kind;
+	bool							set_generate;
+	bool							range_pending;
+	int								range_begin;
+	EntitySet						*current_set;
+	bool							verbose;
+	bool							legacy_lexer;
+};
+
+class Converter
+{
+public:
+	Converter(KeyFile const & kf_) : kf(kf_)
+	{}
+	
+private:
+	KeyFile const & kf;
+};
+
+}
@@ -0,0 +1,308 @@
+// KeyFileLexer.h : Tokenizer for LS-Dyna keyword (.k) files.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Instrumentation.h"
+#include <locale>
+
+namespace d2r
+{
+
+extern std::locale loc;
+
+class LexerSymbol
+{
+public:
+	typedef enum SymbolType_t
+	{
+		WHITESPACE = 0,
+		NEWLINE,
+		COMMENT,
+		COMMA,
+		ASTERISK,
+		WORD,
+		NUMBER,
+		END_OF_FILE
+	}  SymbolType;
+
+	SymbolType	type;
+	string symbol;
+};
+
+template <typename T, int N>
+class Buffer
+{
+	typedef T value_type;
+	typedef typename std::add_pointer<T>::type	pointer_type;
+private:
+	Buffer() {
+		using std::begin;
+		using std::end;
+		std::fill(begin(buf), end(buf), static_cast<value_type>(0));
+	}
+
+	value_type buf[N];
+};
+
+class KeyFileLexer
+{
+	typedef string string;
+
+public:
+	KeyFileLexer(std::istream &stream_) 
+		: stream(stream_)
+		, state(0)
+		, current_line(1)
+		, symbol_count(0)
+		, lex_time(Instrumentation::clock::duration::zero())
+	{
+		stream.unsetf(std::ios_base::skipws);
+	}
+
+	LexerSymbol NextSymbol()
+	{
+		ScopedAccumulator timer(lex_time);
+		symbol_count += 1;
+		LexerSymbol S;
+		//begin reading the symbol
+		char c = stream.peek();
+		switch (state)
+		{
+		case 0: // at the beginning of a line, $ and * are options in addition to everything else
+			while (c == '$') { c = IgnoreComment(); current_line += 1; } //skip comments at the beginning of lines
+			switch (c) {
+			case '*':
+				S = AcceptAsterisk();
+				break;
+			case '\n':
+				S = AcceptNewline();
+				current_line += 1;
+				break;
+			case ' ':
+			case '\t':
+			case 0x0c:
+			case 0x0b:
+				S = AcceptWhitespace();
+				break;
+			case ',':
+				S = AcceptComma();
+				break;
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+			case '-':
+				S = AcceptNumber();
+				break;
+			case EOF:
+				S.type = LexerSymbol::END_OF_FILE; state = -1;
+				break;
+			default:
+				S = AcceptWord();
+			}
+
+			break;
+		case 1: //not at the beginning of a line
+			switch (c) {
+			case '\n':
+				S = AcceptNewline();
+				current_line += 1;
+				break;
+			case ' ':
+			case '\t':
+			case 0x0c:
+			case 0x0b:
+				S = AcceptWhitespace();
+				break;
+			case ',':
+				S = AcceptComma();
+				break;
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+			case '-':
+				S = AcceptNumber();
+				break;
+			case EOF:
+				S.type = LexerSymbol::END_OF_FILE; state = -1;
+				break;
+			default:
+				S = AcceptWord();
+			}
+
+			break; 
+		}
+
+		currentSymbol = S;
+		return S;
+	}
+
+	LexerSymbol GetCurrentSymbol() const
+	{
+		return currentSymbol;
+	}
+
+	int GetCurrentLine() const
+	{
+		return current_line;
+	}
+
+	long long GetSymbolCount() const
+	{
+		return symbol_count;
+	}
+
+	Instrumentation::clock::duration GetLexTime() const
+	{
+		return lex_time;
+	}
+
+protected:
+	char IgnoreComment()
+	{
+		char c;
+		while ((c = stream.peek()) != '\n' && c != EOF)
+		{
+			stream.ignore();
+		}
+		if (c = '\n') stream.ignore();
+		return stream.peek();
+	}
+
+	LexerSymbol AcceptAsterisk()
+	{
+		LexerSymbol S;
+		S.type = LexerSymbol::ASTERISK;
+		S.symbol = "*";
+		stream.ignore();
+
+		state = 1;
+		return S;
+	}
+
+	LexerSymbol AcceptNewline()
+	{
+		LexerSymbol S;
+		S.type = LexerSymbol::NEWLINE;
+		S.symbol = "\n";
+		stream.ignore();
+
+		state = 0;
+		return S;
+	}
+
+	LexerSymbol AcceptWhitespace()
+	{
+		LexerSymbol S;
+		S.type = LexerSymbol::WHITESPACE;
+		S.symbol += stream.get();
+
+		char c;
+		while ((c = stream.peek()) != '\n' && std::isspace(c, loc) && c != EOF)
+		{
+			S.symbol += stream.get();
+		}
+
+		state = 1;
+		return S;
+	}
+
+	LexerSymbol AcceptComma()
+	{
+		LexerSymbol S;
+		S.type = LexerSymbol::COMMA;
+		S.symbol = ",";
+		stream.ignore();
+
+		state = 1;
+		return S;
+	}
+
+	LexerSymbol AcceptWord()
+	{
+		LexerSymbol S;
+		S.type = LexerSymbol::WORD;
+		S.symbol += stream.get();
+
+		char c;
+		while ((c = stream.peek()) != '\n' 
+			&& (!std::isspace(c, loc))
+			&& c != EOF)
+		{
+			S.symbol += stream.get();
+		}
+
+		state = 1;
+		return S;
+	}
+
+	LexerSymbol AcceptNumber()
+	{
+		LexerSymbol S;
+		S.type = LexerSymbol::NUMBER;
+		S.symbol += stream.get();
+
+		//First digits
+		char c;
+		while ((c = stream.peek()) != '\n' && std::isdigit(c, loc) && c != EOF)
+		{
+			S.symbol += stream.get();
+		}
+
+		//We may encounter a decimal place
+		if (stream.peek() == '.') {
+			S.symbol += stream.get();
+		}
+			
+		//Digits after decimal place
+		while ((c = stream.peek()) != '\n' && std::isdigit(c, loc) && c != EOF)
+		{
+			S.symbol += stream.get();
+		}
+
+		//Possible exponent
+		if ((c = stream.peek()) == 'e' || c == 'E')
+		{
+			S.symbol += stream.get();
+		}
+
+		//possible negative sign or positive sign
+		if ((c = stream.peek()) == '-' || c == '+')
+		{
+			S.symbol += stream.get();
+		}
+
+		//Exponent
+		while ((c = stream.peek()) != '\n' && std::isdigit(c, loc) && c != EOF)
+		{
+			S.symbol += stream.get();
+		}
+		return S;
+	}
+
+private:
+	std::istream &stream;
+	int state;
+	LexerSymbol		currentSymbol;
+	int current_line;
+	long long symbol_count;
+	Instrumentation::clock::duration lex_time;
+};
+
+}
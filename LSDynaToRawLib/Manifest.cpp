@@ -0,0 +1,183 @@
+// Manifest.cpp : Record of the inputs and outputs of a conversion, used to redo only the work that changed.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "Manifest.h"
+#include "Instrumentation.h"
+#include <cstring>
+#include <sstream>
+
+namespace d2r
+{
+
+namespace
+{
+	//Word-at-a-time multiplicative hash; the tail is zero padded to a whole word
+	class Hasher
+	{
+	public:
+		Hasher() : h(0x243F6A8885A308D3ull), n(0) {}
+
+		void Update(void const *data, size_t bytes)
+		{
+			unsigned char const *p = static_cast<unsigned char const*>(data);
+			n += bytes;
+			for (; bytes >= 8; p += 8, bytes -= 8)
+			{
+				uint64_t w;
+				std::memcpy(&w, p, 8);
+				Mix(w);
+			}
+			if (bytes) {
+				uint64_t w = 0;
+				std::memcpy(&w, p, bytes);
+				Mix(w);
+			}
+		}
+
+		template <typename T>
+		void Update(vector<T> const &v)
+		{
+			uint64_t size = v.size();
+			Update(&size, sizeof(size));
+			Update(v.data(), v.size() * sizeof(T));
+		}
+
+		uint64_t Final() const
+		{
+			uint64_t x = h ^ n;
+			x ^= x >> 33;
+			x *= 0xFF51AFD7ED558CCDull;
+			x ^= x >> 33;
+			return x;
+		}
+
+	private:
+		void Mix(uint64_t w)
+		{
+			h = (h ^ (w * 0x9E3779B97F4A7C15ull)) * 0xC2B2AE3D27D4EB4Full;
+			h ^= h >> 29;
+		}
+
+		uint64_t h;
+		uint64_t n;
+	};
+
+	string Hex(uint64_t x)
+	{
+		std::ostringstream s;
+		s << std::hex;
+		s.width(16);
+		s.fill('0');
+		s << x;
+		return s.str();
+	}
+}
+
+uint64_t HashFile(fs::path const &file)
+{
+	ScopedTimer timer("HashFile");
+	std::ifstream f(file.string(), std::ios_base::in | std::ios_base::binary);
+	if (f.fail()) throw std::runtime_error("Could not open " + file.string());
+	Hasher h;
+	vector<char> buffer(size_t(1) << 20); //a multiple of 8, so only the last block has a tail
+	while (f.read(buffer.data(), buffer.size()) || f.gcount() > 0)
+	{
+		h.Update(buffer.data(), static_cast<size_t>(f.gcount()));
+	}
+	return h.Final();
+}
+
+uint64_t HashPart(FiniteElementObject const &part)
+{
+	Hasher h;
+	h.Update(part.nodes.nids);
+	h.Update(part.nodes.x);
+	h.Update(part.nodes.y);
+	h.Update(part.nodes.z);
+	h.Update(part.elements.eids);
+	h.Update(part.elements.pids);
+	h.Update(part.elements.n1);
+	h.Update(part.elements.n2);
+	h.Update(part.elements.n3);
+	h.Update(part.elements.n4);
+	h.Update(part.elements.n5);
+	h.Update(part.elements.n6);
+	h.Update(part.elements.n7);
+	h.Update(part.elements.n8);
+	return h.Final();
+}
+
+uint64_t HashString(string const &s)
+{
+	Hasher h;
+	h.Update(s.data(), s.size());
+	return h.Final();
+}
+
+uint64_t HashCombine(uint64_t seed, uint64_t value)
+{
+	Hasher h;
+	h.Update(&seed, sizeof(seed));
+	h.Update(&value, sizeof(value));
+	return h.Final();
+}
+
+Manifest Manifest::Load(fs::path const &file)
+{
+	Manifest m;
+	std::ifstream f(file.string());
+	if (f.fail()) return m;
+
+	string line;
+	while (std::getline(f, line))
+	{
+		size_t tab1 = line.find('\t');
+		size_t tab2 = tab1 == string::npos ? string::npos : line.find('\t', tab1 + 1);
+		if (tab2 == string::npos) continue;
+		string kind = line.substr(0, tab1);
+		uint64_t hash = std::stoull(line.substr(tab1 + 1, tab2 - tab1 - 1), nullptr, 16);
+		string name = line.substr(tab2 + 1);
+		if (kind == "input") m.inputs[name] = hash;
+		else if (kind == "output") m.outputs[name] = hash;
+		else if (kind == "file") m.files[name] = hash;
+		else if (kind == "settings") m.settings = name;
+	}
+	return m;
+}
+
+void Manifest::Save(fs::path const &file) const
+{
+	//write a new file and rename it over the old one, so an interrupted run never leaves half a manifest
+	fs::path tmp = file;
+	tmp += ".tmp";
+	{
+		std::ofstream f(tmp.string());
+		f << "settings\t" << Hex(HashString(settings)) << "\t" << settings << "\n";
+		for (auto it = begin(inputs); it != end(inputs); ++it)
+			f << "input\t" << Hex(it->second) << "\t" << it->first << "\n";
+		for (auto it = begin(outputs); it != end(outputs); ++it)
+			f << "output\t" << Hex(it->second) << "\t" << it->first << "\n";
+		for (auto it = begin(files); it != end(files); ++it)
+			f << "file\t" << Hex(it->second) << "\t" << it->first << "\n";
+		if (f.fail()) throw std::runtime_error("Could not write the manifest " + tmp.string());
+	}
+	fs::rename(tmp, file);
+}
+
+bool Manifest::FilesExist(string const &output) const
+{
+	uint64_t owner = HashString(output);
+	for (auto it = begin(files); it != end(files); ++it)
+		if (it->second == owner && !fs::is_regular_file(it->first)) return false;
+	return true;
+}
+
+void Manifest::KeepFiles(Manifest const &earlier, string const &output)
+{
+	uint64_t owner = HashString(output);
+	for (auto it = begin(earlier.files); it != end(earlier.files); ++it)
+		if (it->second == owner) files.insert(*it);
+}
+
+}
@@ -0,0 +1,55 @@
+// Manifest.h : Record of the inputs and outputs of a conversion, used to redo only the work that changed.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <cstdint>
+
+namespace d2r
+{
+
+//Content hash of a file, or of the nodes and elements of a part.  Not cryptographic; it only has to
+//notice that something was edited.
+uint64_t HashFile(fs::path const &file);
+
+uint64_t HashPart(FiniteElementObject const &part);
+
+uint64_t HashString(string const &s);
+
+//Hash of a pair of hashes, for an output that depends on more than one thing
+uint64_t HashCombine(uint64_t seed, uint64_t value);
+
+//The manifest is a text file of "<kind>\t<hash>\t<name>" lines kept beside the outputs.  Inputs are
+//keyed by their canonical path, outputs by the base name they were written under, and the settings
+//line holds everything else that changes the outputs (merge tolerance and so on).  Every file written
+//for an output is listed with the hash of the output's base name, so that an output whose files were
+//deleted is written again.
+class Manifest
+{
+public:
+	//Returns an empty manifest if the file does not exist
+	static Manifest Load(fs::path const &file);
+
+	void Save(fs::path const &file) const;
+
+	void AddFile(string const &output, string const &file)
+	{
+		files[file] = HashString(output);
+	}
+
+	//Whether every file listed for the output still exists
+	bool FilesExist(string const &output) const;
+
+	//Lists the files of an output that was left as it was on an earlier run
+	void KeepFiles(Manifest const &earlier, string const &output);
+
+	std::map<string, uint64_t>	inputs;
+	std::map<string, uint64_t>	outputs;
+	std::map<string, uint64_t>	files;
+	string						settings;
+};
+
+}
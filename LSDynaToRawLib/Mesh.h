@@ -0,0 +1,146 @@
+// Mesh.h : Structure-of-arrays containers for the nodes and elements of a finite element mesh.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+
+namespace d2r
+{
+
+typedef std::tuple<double, double, double> Node;
+typedef std::tuple<int, int, int, int, int, int, int, int> Element;
+
+struct Nodes
+{
+	void AddNode(int id, double x_, double y_, double z_)
+	{
+		nids.push_back(id);
+		x.push_back(x_);
+		y.push_back(y_);
+		z.push_back(z_);
+	}
+
+	void AddNode(int id, Node const &x_)
+	{
+		nids.push_back(id);
+		x.push_back(get<0>(x_));
+		y.push_back(get<1>(x_));
+		z.push_back(get<2>(x_));
+	}
+
+	Node GetNode(int k) const
+	{
+		return make_tuple(
+			x.at(k)
+			, y.at(k)
+			, z.at(k)
+		);
+	}
+
+	int GetNodeID(int k) const
+	{
+		return nids.at(k);
+	}
+
+	vector<double> nids;
+	vector<double> x;
+	vector<double> y;
+	vector<double> z;
+};
+
+struct Elements
+{
+	void AddElement(int eid_, int pid_, Element const &e_)
+	{
+		//ensure the element id is unique
+		if (std::find(begin(eids), end(eids), eid_) != end(eids)) {
+			throw std::runtime_error("Found two elements with the same element id");
+		}
+
+		eids.push_back(eid_);
+		pids.push_back(pid_);
+		n1.push_back(get<0>(e_));
+		n2.push_back(get<1>(e_));
+		n3.push_back(get<2>(e_));
+		n4.push_back(get<3>(e_));
+		n5.push_back(get<4>(e_));
+		n6.push_back(get<5>(e_));
+		n7.push_back(get<6>(e_));
+		n8.push_back(get<7>(e_));
+	}
+
+	Element FindElement(int eid_)
+	{
+		auto it = std::find(begin(eids), end(eids), eid_);
+		if (it == end(eids)) throw std::runtime_error("Could not find a requested element id");
+		int index = it - begin(eids);
+
+		return std::make_tuple(
+			n1.at(index)
+			, n2.at(index)
+			, n3.at(index)
+			, n4.at(index)
+			, n5.at(index)
+			, n6.at(index)
+			, n7.at(index)
+			, n8.at(index)
+		);
+	}
+
+	Element GetElement(int k) const
+	{
+		return std::make_tuple(
+			n1.at(k)
+			, n2.at(k)
+			, n3.at(k)
+			, n4.at(k)
+			, n5.at(k)
+			, n6.at(k)
+			, n7.at(k)
+			, n8.at(k)
+		);
+	}
+
+	int GetElementID(int k) const
+	{
+		return eids.at(k);
+	}
+
+	int GetPartID(int k) const
+	{
+		return pids.at(k);
+	}
+
+	vector<int> eids;
+	vector<int> pids;
+	vector<int> n1;
+	vector<int> n2;
+	vector<int> n3;
+	vector<int> n4;
+	vector<int> n5;
+	vector<int> n6;
+	vector<int> n7;
+	vector<int> n8;
+};
+
+struct FiniteElementObject
+{
+	Nodes	nodes;
+	Elements elements;
+	map<int, int>	element_index;
+	map<int, int>	node_index; //maps node ids to vector positions in the nodes list
+
+	Element GetElement(int eid) const
+	{
+		return elements.GetElement(element_index.at(eid));
+	}
+
+	Node GetNode(int nid) const
+	{
+		return nodes.GetNode(node_index.at(nid));
+	}
+};
+
+}
@@ -0,0 +1,352 @@
+// MeshQuality.cpp : Element quality metrics (scaled Jacobian, aspect ratio, warpage and edge lengths) and
+//					 per part reports of their distribution.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "MeshQuality.h"
+#include "MeshTools.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace d2r
+{
+
+namespace
+{
+	const size_t BATCH = 64;
+
+	const int EDGES[12][2] = { {0,1}, {1,2}, {2,3}, {3,0}, {4,5}, {5,6}, {6,7}, {7,4}, {0,4}, {1,5}, {2,6}, {3,7} };
+
+	//the edges of a tetrahedron written as n1, n2, n3, n4, n4, n4, n4, n4, whose n1-n3 edge is not an edge of the hexahedron
+	const int TET_EDGES[6][2] = { {0,1}, {1,2}, {2,0}, {0,3}, {1,3}, {2,3} };
+
+	//the shapes a solid element card can describe by repeating nodes
+	enum Shape { HEXAHEDRON, WEDGE, PYRAMID, TETRAHEDRON };
+
+	//A corner of one shape and its three neighbors, ordered so that the Jacobian of an undistorted element
+	//is positive
+	struct Corner
+	{
+		int shape;
+		int k;
+		int neighbors[3];
+	};
+
+	//the hexahedron's corners; a wedge is written as n1, n2, n3, n4, n5, n5, n6, n6, a pyramid as n1 .. n5, n5, n5, n5
+	//and a tetrahedron as n1, n2, n3, n4, n4, n4, n4, n4, so their corners have neighbors the hexahedron does
+	//not have.  The apex of a pyramid has four neighbors and is measured on each three consecutive ones.
+	const Corner CORNERS[] = {
+		{ HEXAHEDRON, 0, {1,3,4} }, { HEXAHEDRON, 1, {2,0,5} }, { HEXAHEDRON, 2, {3,1,6} }, { HEXAHEDRON, 3, {0,2,7} },
+		{ HEXAHEDRON, 4, {7,5,0} }, { HEXAHEDRON, 5, {4,6,1} }, { HEXAHEDRON, 6, {5,7,2} }, { HEXAHEDRON, 7, {6,4,3} },
+		{ WEDGE, 0, {1,3,4} }, { WEDGE, 1, {2,0,4} }, { WEDGE, 2, {3,1,6} }, { WEDGE, 3, {0,2,6} },
+		{ WEDGE, 4, {1,0,6} }, { WEDGE, 6, {3,2,4} },
+		{ PYRAMID, 0, {1,3,4} }, { PYRAMID, 1, {2,0,4} }, { PYRAMID, 2, {3,1,4} }, { PYRAMID, 3, {0,2,4} },
+		{ PYRAMID, 4, {1,0,2} }, { PYRAMID, 4, {2,1,3} }, { PYRAMID, 4, {3,2,0} }, { PYRAMID, 4, {0,3,1} },
+		{ TETRAHEDRON, 0, {1,2,3} }, { TETRAHEDRON, 1, {2,0,3} }, { TETRAHEDRON, 2, {0,1,3} }, { TETRAHEDRON, 3, {1,0,2} }
+	};
+
+	const int FACES[6][4] = { {0,1,2,3}, {4,5,6,7}, {0,1,5,4}, {1,2,6,5}, {2,3,7,6}, {3,0,4,7} };
+
+	const double INF = std::numeric_limits<double>::infinity();
+	const double NaN = std::numeric_limits<double>::quiet_NaN();
+	const double PI = 3.14159265358979323846;
+
+	//Corner coordinates of up to BATCH elements, by corner and then by element, so that each loop over
+	//the elements of the batch reads consecutive memory.  Unused corners have position -1.
+	struct Batch
+	{
+		double x[8][BATCH];
+		double y[8][BATCH];
+		double z[8][BATCH];
+		int32_t p[8][BATCH];
+	};
+
+	//Cosine of the angle between the normals of triangles (a,b,c) and (a,c,d), for every element of the batch
+	void FoldCosine(Batch const &B, int a, int b, int c, int d, size_t n, double *cosine)
+	{
+		for (size_t l = 0; l < n; ++l)
+		{
+			double ux = B.x[b][l] - B.x[a][l], uy = B.y[b][l] - B.y[a][l], uz = B.z[b][l] - B.z[a][l];
+			double vx = B.x[c][l] - B.x[a][l], vy = B.y[c][l] - B.y[a][l], vz = B.z[c][l] - B.z[a][l];
+			double wx = B.x[d][l] - B.x[a][l], wy = B.y[d][l] - B.y[a][l], wz = B.z[d][l] - B.z[a][l];
+			double n1x = uy * vz - uz * vy, n1y = uz * vx - ux * vz, n1z = ux * vy - uy * vx;
+			double n2x = vy * wz - vz * wy, n2y = vz * wx - vx * wz, n2z = vx * wy - vy * wx;
+			double dot = n1x * n2x + n1y * n2y + n1z * n2z;
+			double norms = (n1x * n1x + n1y * n1y + n1z * n1z) * (n2x * n2x + n2y * n2y + n2z * n2z);
+			cosine[l] = norms > 0 ? dot / std::sqrt(norms) : 1.0;
+		}
+	}
+
+	void MeasureBatch(Batch const &B, size_t n, double *jacobian, double *aspect, double *warpage, double *min_edge, double *max_edge)
+	{
+		double lo[BATCH], hi[BATCH], jac[BATCH], fold[BATCH], cosine[BATCH];
+		for (size_t l = 0; l < n; ++l) {
+			lo[l] = INF;
+			hi[l] = 0;
+			jac[l] = INF;
+			fold[l] = INF;
+		}
+
+		//a tetrahedron (n4 through n8 the same node) has only triangular faces, although n1..n4 are four different nodes.
+		//Elements that repeat nodes in any other way are measured on the hexahedron's corners that remain.
+		int shape[BATCH];
+		bool tetrahedron[BATCH];
+		bool present[4] = { false, false, false, false };
+		for (size_t l = 0; l < n; ++l)
+		{
+			bool top = B.p[4][l] == B.p[5][l] && B.p[6][l] == B.p[7][l] && B.p[4][l] >= 0 && B.p[6][l] >= 0;
+			bool apex = top && B.p[5][l] == B.p[6][l];
+			tetrahedron[l] = apex && B.p[3][l] == B.p[4][l];
+			shape[l] = tetrahedron[l] ? TETRAHEDRON : apex ? PYRAMID : top ? WEDGE : HEXAHEDRON;
+			present[shape[l]] = true;
+		}
+
+		//every element is run through both edge tables, and each edge only counts for the shape it belongs to
+		for (int k = 0; k < 12 + 6; ++k)
+		{
+			bool tet_edge = k >= 12;
+			int a = tet_edge ? TET_EDGES[k - 12][0] : EDGES[k][0], b = tet_edge ? TET_EDGES[k - 12][1] : EDGES[k][1];
+			for (size_t l = 0; l < n; ++l)
+			{
+				double dx = B.x[b][l] - B.x[a][l], dy = B.y[b][l] - B.y[a][l], dz = B.z[b][l] - B.z[a][l];
+				double length2 = dx * dx + dy * dy + dz * dz;
+				bool valid = tetrahedron[l] == tet_edge && B.p[a][l] >= 0 && B.p[b][l] >= 0 && B.p[a][l] != B.p[b][l];
+				lo[l] = valid && length2 < lo[l] ? length2 : lo[l];
+				hi[l] = valid && length2 > hi[l] ? length2 : hi[l];
+			}
+		}
+
+		//every element is run through the corners of all the shapes in its batch, and each corner only counts for its own shape
+		for (Corner const &corner : CORNERS)
+		{
+			if (!present[corner.shape]) continue;
+			int k = corner.k, a = corner.neighbors[0], b = corner.neighbors[1], c = corner.neighbors[2];
+			for (size_t l = 0; l < n; ++l)
+			{
+				double ux = B.x[a][l] - B.x[k][l], uy = B.y[a][l] - B.y[k][l], uz = B.z[a][l] - B.z[k][l];
+				double vx = B.x[b][l] - B.x[k][l], vy = B.y[b][l] - B.y[k][l], vz = B.z[b][l] - B.z[k][l];
+				double wx = B.x[c][l] - B.x[k][l], wy = B.y[c][l] - B.y[k][l], wz = B.z[c][l] - B.z[k][l];
+				double det = (uy * vz - uz * vy) * wx + (uz * vx - ux * vz) * wy + (ux * vy - uy * vx) * wz;
+				double norms = (ux * ux + uy * uy + uz * uz) * (vx * vx + vy * vy + vz * vz) * (wx * wx + wy * wy + wz * wz);
+				double scaled = norms > 0 ? det / std::sqrt(norms) : INF;
+
+				//a corner is only a corner if it and its three neighbors are four different nodes
+				int32_t pk = B.p[k][l], pa = B.p[a][l], pb = B.p[b][l], pc = B.p[c][l];
+				bool valid = shape[l] == corner.shape && pk >= 0 && pa >= 0 && pb >= 0 && pc >= 0
+					&& pk != pa && pk != pb && pk != pc && pa != pb && pa != pc && pb != pc;
+				jac[l] = valid && scaled < jac[l] ? scaled : jac[l];
+			}
+		}
+
+		for (int f = 0; f < 6; ++f)
+		{
+			int a = FACES[f][0], b = FACES[f][1], c = FACES[f][2], d = FACES[f][3];
+			//the warpage of a face is the worse of its two splits into triangles
+			for (int split = 0; split < 2; ++split)
+			{
+				if (split == 0) FoldCosine(B, a, b, c, d, n, cosine);
+				else FoldCosine(B, b, c, d, a, n, cosine);
+				for (size_t l = 0; l < n; ++l)
+				{
+					int32_t pa = B.p[a][l], pb = B.p[b][l], pc = B.p[c][l], pd = B.p[d][l];
+					bool valid = !tetrahedron[l] && pa >= 0 && pb >= 0 && pc >= 0 && pd >= 0
+						&& pa != pb && pa != pc && pa != pd && pb != pc && pb != pd && pc != pd;
+					fold[l] = valid && cosine[l] < fold[l] ? cosine[l] : fold[l];
+				}
+			}
+		}
+
+		for (size_t l = 0; l < n; ++l)
+		{
+			min_edge[l] = lo[l] == INF ? NaN : std::sqrt(lo[l]);
+			max_edge[l] = lo[l] == INF ? NaN : std::sqrt(hi[l]);
+			aspect[l] = lo[l] == INF || lo[l] == 0 ? NaN : std::sqrt(hi[l] / lo[l]);
+			jacobian[l] = jac[l] == INF ? NaN : jac[l];
+			warpage[l] = fold[l] == INF ? NaN : std::acos(std::max(-1.0, std::min(1.0, fold[l]))) * 180.0 / PI;
+		}
+	}
+
+	//Range of the defined values of a metric over a subset of the elements
+	std::pair<double, double> Range(vector<double> const &metric, vector<size_t> const &elements)
+	{
+		double lo = INF, hi = -INF;
+		for (auto it = elements.begin(); it != elements.end(); ++it)
+		{
+			double v = metric[*it];
+			if (std::isnan(v)) continue;
+			lo = std::min(lo, v);
+			hi = std::max(hi, v);
+		}
+		return lo > hi ? std::make_pair(NaN, NaN) : std::make_pair(lo, hi);
+	}
+
+	Histogram MakeHistogram(vector<double> const &metric, vector<size_t> const &elements, double lo, double hi)
+	{
+		Histogram h;
+		h.lo = lo;
+		h.hi = hi;
+		std::fill(begin(h.counts), end(h.counts), 0);
+		for (auto it = elements.begin(); it != elements.end(); ++it) h.Add(metric[*it]);
+		return h;
+	}
+
+	//The n elements with the lowest (or highest) defined values, worst first; ties go to the element that comes first
+	vector<std::pair<int, double>> Worst(vector<double> const &metric, vector<size_t> const &elements, vector<int> const &eids,
+		size_t n, bool lowest)
+	{
+		vector<size_t> defined;
+		for (auto it = elements.begin(); it != elements.end(); ++it)
+			if (!std::isnan(metric[*it])) defined.push_back(*it);
+
+		auto worse = [&](size_t a, size_t b) {
+			if (metric[a] != metric[b]) return lowest ? metric[a] < metric[b] : metric[a] > metric[b];
+			return a < b;
+		};
+		n = std::min(n, defined.size());
+		std::partial_sort(defined.begin(), defined.begin() + n, defined.end(), worse);
+
+		vector<std::pair<int, double>> worst;
+		for (size_t i = 0; i < n; ++i) worst.push_back(std::make_pair(eids[defined[i]], metric[defined[i]]));
+		return worst;
+	}
+
+	void WriteHistogram(std::ostream &f, string const &name, Histogram const &h)
+	{
+		f << "histogram\t" << name << endl;
+		double width = (h.hi - h.lo) / Histogram::BINS;
+		for (int b = 0; b < Histogram::BINS; ++b)
+			f << h.lo + b * width << "\t" << h.lo + (b + 1) * width << "\t" << h.counts[b] << endl;
+	}
+
+	void WriteWorst(std::ostream &f, string const &name, vector<std::pair<int, double>> const &worst)
+	{
+		f << "worst\t" << name << endl;
+		for (auto it = worst.begin(); it != worst.end(); ++it) f << it->first << "\t" << it->second << endl;
+	}
+}
+
+void Histogram::Add(double value)
+{
+	if (std::isnan(value)) return;
+	int bin = 0;
+	if (hi > lo) bin = static_cast<int>(std::floor((value - lo) / (hi - lo) * BINS));
+	++counts[std::max(0, std::min(BINS - 1, bin))];
+}
+
+ElementQuality MeasureQuality(FiniteElementObject const &objects)
+{
+	ScopedTimer timer("MeasureQuality");
+	Elements const &E = objects.elements;
+	Nodes const &N = objects.nodes;
+	size_t nElements = E.eids.size();
+	ElementQuality Q;
+	Q.jacobian.resize(nElements);
+	Q.aspect.resize(nElements);
+	Q.warpage.resize(nElements);
+	Q.min_edge.resize(nElements);
+	Q.max_edge.resize(nElements);
+
+	vector<int> const *columns[8] = { &E.n1, &E.n2, &E.n3, &E.n4, &E.n5, &E.n6, &E.n7, &E.n8 };
+	size_t nBatches = (nElements + BATCH - 1) / BATCH;
+	ParallelFor(nBatches, [&](size_t first, size_t last) {
+		std::unique_ptr<Batch> B(new Batch);
+		long long lookups = 0;
+		for (size_t batch = first; batch < last; ++batch)
+		{
+			size_t begin = batch * BATCH;
+			size_t n = std::min(BATCH, nElements - begin);
+			for (int k = 0; k < 8; ++k)
+			{
+				for (size_t l = 0; l < n; ++l)
+				{
+					int nid = (*columns[k])[begin + l];
+					//a node that is not defined is left out like an unused corner
+					auto it = nid == 0 ? objects.node_index.end() : objects.node_index.find(nid);
+					int32_t position = it == objects.node_index.end() ? -1 : it->second;
+					lookups += nid != 0;
+					B->p[k][l] = position;
+					B->x[k][l] = position < 0 ? 0.0 : N.x[position];
+					B->y[k][l] = position < 0 ? 0.0 : N.y[position];
+					B->z[k][l] = position < 0 ? 0.0 : N.z[position];
+				}
+			}
+			MeasureBatch(*B, n, &Q.jacobian[begin], &Q.aspect[begin], &Q.warpage[begin], &Q.min_edge[begin], &Q.max_edge[begin]);
+		}
+		Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS, lookups);
+	}, 16);
+	return Q;
+}
+
+std::map<int, QualityReport> SummarizeQuality(FiniteElementObject const &objects, ElementQuality const &quality, size_t worst_n)
+{
+	ScopedTimer timer("SummarizeQuality");
+	std::map<int, vector<size_t>> by_part;
+	for (size_t i = 0; i < objects.elements.pids.size(); ++i) by_part[objects.elements.pids[i]].push_back(i);
+	vector<std::pair<int, vector<size_t>>> parts(by_part.begin(), by_part.end());
+
+	vector<QualityReport> reports(parts.size());
+	ParallelFor(parts.size(), [&](size_t first, size_t last) {
+		for (size_t p = first; p < last; ++p)
+		{
+			vector<size_t> const &elements = parts[p].second;
+			QualityReport &R = reports[p];
+			R.nElements = static_cast<long long>(elements.size());
+			R.min_jacobian = Range(quality.jacobian, elements).first;
+			R.max_aspect = Range(quality.aspect, elements).second;
+			R.max_warpage = Range(quality.warpage, elements).second;
+			R.min_edge = Range(quality.min_edge, elements).first;
+			R.max_edge = Range(quality.max_edge, elements).second;
+
+			//the Jacobian has a fixed range; the others are binned over the range found in the part
+			R.jacobian = MakeHistogram(quality.jacobian, elements, -1.0, 1.0);
+			R.aspect = MakeHistogram(quality.aspect, elements, 1.0, std::isnan(R.max_aspect) ? 1.0 : R.max_aspect);
+			R.warpage = MakeHistogram(quality.warpage, elements, 0.0, std::isnan(R.max_warpage) ? 0.0 : R.max_warpage);
+			R.min_edge_length = MakeHistogram(quality.min_edge, elements, R.min_edge, R.max_edge);
+			R.max_edge_length = MakeHistogram(quality.max_edge, elements, R.min_edge, R.max_edge);
+
+			R.worst_jacobian = Worst(quality.jacobian, elements, objects.elements.eids, worst_n, true);
+			R.worst_aspect = Worst(quality.aspect, elements, objects.elements.eids, worst_n, false);
+			R.worst_warpage = Worst(quality.warpage, elements, objects.elements.eids, worst_n, false);
+		}
+	}, 1);
+
+	std::map<int, QualityReport> summary;
+	for (size_t p = 0; p < parts.size(); ++p) summary[parts[p].first] = reports[p];
+	return summary;
+}
+
+void WriteQualityReport(std::ostream &f, string const &part_name, QualityReport const &report)
+{
+	f.precision(8);
+	f << "part\t" << part_name << endl;
+	f << "elements\t" << report.nElements << endl;
+	f << "min scaled jacobian\t" << report.min_jacobian << endl;
+	f << "max aspect ratio\t" << report.max_aspect << endl;
+	f << "max warpage\t" << report.max_warpage << endl;
+	f << "min edge length\t" << report.min_edge << endl;
+	f << "max edge length\t" << report.max_edge << endl;
+	WriteHistogram(f, "scaled jacobian", report.jacobian);
+	WriteHistogram(f, "aspect ratio", report.aspect);
+	WriteHistogram(f, "warpage", report.warpage);
+	WriteHistogram(f, "min edge length", report.min_edge_length);
+	WriteHistogram(f, "max edge length", report.max_edge_length);
+	WriteWorst(f, "scaled jacobian", report.worst_jacobian);
+	WriteWorst(f, "aspect ratio", report.worst_aspect);
+	WriteWorst(f, "warpage", report.worst_warpage);
+}
+
+void OutputQualityReport(string const &file_name, string const &part_name, QualityReport const &report, bool overwrite)
+{
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		std::ofstream f(outfile.string());
+		WriteQualityReport(f, part_name, report);
+		Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(f.tellp()));
+	}
+}
+
+}
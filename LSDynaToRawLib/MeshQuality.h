@@ -0,0 +1,75 @@
+// MeshQuality.h : Element quality metrics (scaled Jacobian, aspect ratio, warpage and edge lengths) and
+//				   per part reports of their distribution.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+
+namespace d2r
+{
+
+//One value of each metric per element, in the order of the elements of the object that was measured.
+//Metrics that are not defined for an element (the Jacobian of a shell, the warpage of a tetrahedron)
+//are NaN.
+struct ElementQuality
+{
+	vector<double> jacobian;	//minimum over the corners of the scaled Jacobian, in [-1, 1]; 1 for a cube
+	vector<double> aspect;		//longest edge over shortest edge
+	vector<double> warpage;		//largest angle in degrees between the two triangles of a quadrilateral face
+	vector<double> min_edge;
+	vector<double> max_edge;
+};
+
+struct Histogram
+{
+	static const int BINS = 20;
+
+	//values outside [lo, hi] are counted in the first or last bin
+	void Add(double value);
+
+	double lo;
+	double hi;
+	long long counts[BINS];
+};
+
+struct QualityReport
+{
+	//element count and metric ranges over the elements on which each metric is defined
+	long long nElements;
+	double min_jacobian;
+	double max_aspect;
+	double max_warpage;
+	double min_edge;
+	double max_edge;
+
+	Histogram jacobian;
+	Histogram aspect;
+	Histogram warpage;
+	Histogram min_edge_length;
+	Histogram max_edge_length;
+
+	//IDs and values of the worst elements by each metric, worst first
+	vector<std::pair<int, double>> worst_jacobian;
+	vector<std::pair<int, double>> worst_aspect;
+	vector<std::pair<int, double>> worst_warpage;
+};
+
+//Wedges, pyramids and tetrahedra, written as hexahedra with repeated nodes, are measured at each of their
+//own corners, and their collapsed edges and faces are left out of the metrics.
+//The elements are measured in parallel, a batch at a time: the corner coordinates of a batch are
+//gathered into arrays by corner and the metrics are computed across the batch with branch-free loops
+//that the compiler vectorizes.
+ElementQuality MeasureQuality(FiniteElementObject const &objects);
+
+//Histograms and the worst_n worst elements of every part, computed in parallel across the parts
+std::map<int, QualityReport> SummarizeQuality(FiniteElementObject const &objects, ElementQuality const &quality, size_t worst_n);
+
+//The text of OutputQualityReport, which --incremental also hashes to tell whether a report changed
+void WriteQualityReport(std::ostream &f, string const &part_name, QualityReport const &report);
+
+void OutputQualityReport(string const &file_name, string const &part_name, QualityReport const &report, bool overwrite = false);
+
+}
@@ -0,0 +1,476 @@
+// MeshTools.cpp : Operations on parsed meshes: part isolation, node merging, renumbering and output.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "MeshTools.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <cmath>
+#include <cstdint>
+
+namespace d2r
+{
+
+namespace
+{
+	int NodeIndex(FiniteElementObject const &objects, int nid)
+	{
+		auto it = objects.node_index.find(nid);
+		if (it == objects.node_index.end())
+			throw std::runtime_error("An element refers to node " + std::to_string(nid) + ", which is not defined in the input.");
+		return it->second;
+	}
+}
+
+FiniteElementObject IsolatePart(std::map<int, Elements> & /*parts*/,
+	FiniteElementObject &objects,
+	int pid)
+{
+	return IsolatePart(static_cast<FiniteElementObject const &>(objects), pid);
+}
+
+FiniteElementObject IsolatePart(FiniteElementObject const &objects, int pid)
+{
+	ScopedTimer timer("IsolatePart");
+	FiniteElementObject part;
+	for (size_t i = 0; i < objects.elements.eids.size(); ++i)
+	{
+		//if the part id matches, copy to the output
+		if (objects.elements.pids.at(i) == pid)
+		{
+			part.elements.eids.push_back(objects.elements.eids.at(i));
+			part.elements.pids.push_back(objects.elements.pids.at(i));
+			part.elements.n1.push_back(objects.elements.n1.at(i));
+			part.elements.n2.push_back(objects.elements.n2.at(i));
+			part.elements.n3.push_back(objects.elements.n3.at(i));
+			part.elements.n4.push_back(objects.elements.n4.at(i));
+			part.elements.n5.push_back(objects.elements.n5.at(i));
+			part.elements.n6.push_back(objects.elements.n6.at(i));
+			part.elements.n7.push_back(objects.elements.n7.at(i));
+			part.elements.n8.push_back(objects.elements.n8.at(i));
+
+			part.element_index[objects.elements.eids.at(i)] = part.elements.eids.size() - 1;
+			
+			//copy only the nodes that aren't already in the set, and don't copy the node with index zero
+			if (part.node_index.count(part.elements.n1.back()) == 0 && part.elements.n1.back() != 0)
+			{
+				int nid = part.elements.n1.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n2.back()) == 0 && part.elements.n2.back() != 0)
+			{
+				int nid = part.elements.n2.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n3.back()) == 0 && part.elements.n3.back() != 0)
+			{
+				int nid = part.elements.n3.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n4.back()) == 0 && part.elements.n4.back() != 0)
+			{
+				int nid = part.elements.n4.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n5.back()) == 0 && part.elements.n5.back() != 0)
+			{
+				int nid = part.elements.n5.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n6.back()) == 0 && part.elements.n6.back() != 0)
+			{
+				int nid = part.elements.n6.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n7.back()) == 0 && part.elements.n7.back() != 0)
+			{
+				int nid = part.elements.n7.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+
+			//copy only the nodes that aren't already in the set
+			if (part.node_index.count(part.elements.n8.back()) == 0 && part.elements.n8.back() != 0)
+			{
+				int nid = part.elements.n8.back();
+				part.nodes.nids.push_back(nid);
+				int old_index = NodeIndex(objects, nid);
+				part.nodes.x.push_back(objects.nodes.x.at(old_index));
+				part.nodes.y.push_back(objects.nodes.y.at(old_index));
+				part.nodes.z.push_back(objects.nodes.z.at(old_index));
+				part.node_index[nid] = part.nodes.x.size() - 1;
+			}
+		}
+	}
+
+	//one element_index insert and eight node_index probes per element, plus a lookup and an insert per new node
+	Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS,
+		9 * static_cast<long long>(part.elements.eids.size()) + 2 * static_cast<long long>(part.nodes.nids.size()));
+	return part;
+}
+
+//Hashes the integer coordinates of a grid cell.  Two cells may share a hash, which only means
+//that their nodes are compared against each other; the distance check below keeps the result exact.
+inline uint64_t HashCell(int64_t i, int64_t j, int64_t k)
+{
+	uint64_t h = static_cast<uint64_t>(i) * 0x9E3779B97F4A7C15ull;
+	h ^= static_cast<uint64_t>(j) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+	h ^= static_cast<uint64_t>(k) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+	return h;
+}
+
+void RemapConnectivity(vector<int> &n, vector<int> const &old_ids, vector<int> const &new_ids)
+{
+	ParallelFor(n.size(), [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+		{
+			auto it = std::lower_bound(begin(old_ids), end(old_ids), n[i]);
+			if (it != end(old_ids) && *it == n[i]) n[i] = new_ids[it - begin(old_ids)];
+		}
+	});
+}
+
+void RemapConnectivity(Elements &e, vector<int> const &old_ids, vector<int> const &new_ids)
+{
+	RemapConnectivity(e.n1, old_ids, new_ids);
+	RemapConnectivity(e.n2, old_ids, new_ids);
+	RemapConnectivity(e.n3, old_ids, new_ids);
+	RemapConnectivity(e.n4, old_ids, new_ids);
+	RemapConnectivity(e.n5, old_ids, new_ids);
+	RemapConnectivity(e.n6, old_ids, new_ids);
+	RemapConnectivity(e.n7, old_ids, new_ids);
+	RemapConnectivity(e.n8, old_ids, new_ids);
+}
+
+FiniteElementObject ExtractElements(FiniteElementObject const &objects, vector<size_t> const &element_indices)
+{
+	ScopedTimer timer("ExtractElements");
+	FiniteElementObject part;
+	long long lookups = 0;
+	Elements const &E = objects.elements;
+	vector<int> const *columns[8] = { &E.n1, &E.n2, &E.n3, &E.n4, &E.n5, &E.n6, &E.n7, &E.n8 };
+	vector<int> *out[8] = { &part.elements.n1, &part.elements.n2, &part.elements.n3, &part.elements.n4,
+		&part.elements.n5, &part.elements.n6, &part.elements.n7, &part.elements.n8 };
+
+	for (size_t j = 0; j < element_indices.size(); ++j)
+	{
+		size_t i = element_indices[j];
+		part.elements.eids.push_back(E.eids[i]);
+		part.elements.pids.push_back(E.pids[i]);
+		part.element_index[E.eids[i]] = static_cast<int>(part.elements.eids.size()) - 1;
+		lookups += 1;
+		for (int k = 0; k < 8; ++k)
+		{
+			int nid = (*columns[k])[i];
+			out[k]->push_back(nid);
+
+			//copy only the nodes that aren't already in the set, and don't copy the node with index zero
+			if (nid == 0) continue;
+			lookups += 1;
+			if (part.node_index.count(nid)) continue;
+			int old_index = NodeIndex(objects, nid);
+			part.nodes.AddNode(nid, objects.nodes.x[old_index], objects.nodes.y[old_index], objects.nodes.z[old_index]);
+			part.node_index[nid] = static_cast<int>(part.nodes.nids.size()) - 1;
+			lookups += 2;
+		}
+	}
+	Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS, lookups);
+	return part;
+}
+
+int MergeCoincidentNodes(std::map<int, Elements> &parts,
+	FiniteElementObject &objects,
+	double tolerance)
+{
+	ScopedTimer timer("MergeCoincidentNodes");
+	Nodes &n = objects.nodes;
+	size_t N = n.nids.size();
+	if (N < 2 || !(tolerance > 0)) return 0;
+
+	//bin every node into the grid
+	vector<std::pair<uint64_t, int>> cells(N);
+	ParallelFor(N, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+		{
+			cells[i] = std::make_pair(
+				HashCell(
+					static_cast<int64_t>(std::floor(n.x[i] / tolerance)),
+					static_cast<int64_t>(std::floor(n.y[i] / tolerance)),
+					static_cast<int64_t>(std::floor(n.z[i] / tolerance))),
+				static_cast<int>(i));
+		}
+	});
+
+	//sort by cell so that each cell is a contiguous run: one chunk per thread is sorted, then pairs of
+	//sorted runs are merged, the merges of each pass running in parallel.  The grain of 1 gives every
+	//chunk, and every merge, a thread of its own.
+	{
+		size_t nChunks = std::max(1u, std::thread::hardware_concurrency());
+		size_t chunk = (N + nChunks - 1) / nChunks;
+		ParallelFor(nChunks, [&](size_t b, size_t e) {
+			for (size_t c = b; c < e; ++c)
+			{
+				size_t first = std::min(N, c * chunk), last = std::min(N, first + chunk);
+				std::sort(cells.begin() + first, cells.begin() + last);
+			}
+		}, 1);
+		for (size_t width = chunk; width < N; width *= 2)
+		{
+			size_t nMerges = (N + 2 * width - 1) / (2 * width);
+			ParallelFor(nMerges, [&](size_t b, size_t e) {
+				for (size_t m = b; m < e; ++m)
+				{
+					size_t first = m * 2 * width;
+					if (first + width >= N) continue;
+					std::inplace_merge(cells.begin() + first,
+						cells.begin() + first + width,
+						cells.begin() + std::min(N, first + 2 * width));
+				}
+			}, 1);
+		}
+	}
+
+	//for each node, find the lowest-index node within tolerance (possibly itself)
+	double tol2 = tolerance * tolerance;
+	vector<int> nearest(N);
+	ParallelFor(N, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+		{
+			int64_t ci = static_cast<int64_t>(std::floor(n.x[i] / tolerance));
+			int64_t cj = static_cast<int64_t>(std::floor(n.y[i] / tolerance));
+			int64_t ck = static_cast<int64_t>(std::floor(n.z[i] / tolerance));
+			int best = static_cast<int>(i);
+			for (int di = -1; di <= 1; ++di)
+				for (int dj = -1; dj <= 1; ++dj)
+					for (int dk = -1; dk <= 1; ++dk)
+					{
+						uint64_t h = HashCell(ci + di, cj + dj, ck + dk);
+						auto it = std::lower_bound(begin(cells), end(cells), std::make_pair(h, 0));
+						for (; it != end(cells) && it->first == h; ++it)
+						{
+							int j = it->second;
+							if (j >= best) break; //runs are sorted by node index
+							double dx = n.x[i] - n.x[j], dy = n.y[i] - n.y[j], dz = n.z[i] - n.z[j];
+							if (dx * dx + dy * dy + dz * dz <= tol2) best = j;
+						}
+					}
+			nearest[i] = best;
+		}
+	});
+
+	//nearest[i] <= i, so resolving in index order collapses chains onto the first node of each cluster
+	vector<int> rep(N);
+	for (size_t i = 0; i < N; ++i)
+	{
+		rep[i] = (nearest[i] == static_cast<int>(i)) ? static_cast<int>(i) : rep[nearest[i]];
+	}
+
+	//sorted table of merged node ids and their replacements
+	vector<std::pair<int, int>> remap;
+	for (size_t i = 0; i < N; ++i)
+	{
+		if (rep[i] != static_cast<int>(i))
+			remap.push_back(std::make_pair(static_cast<int>(n.nids[i]), static_cast<int>(n.nids[rep[i]])));
+	}
+	if (remap.empty()) return 0;
+	std::sort(begin(remap), end(remap));
+	vector<int> old_ids(remap.size()), new_ids(remap.size());
+	for (size_t k = 0; k < remap.size(); ++k)
+	{
+		old_ids[k] = remap[k].first;
+		new_ids[k] = remap[k].second;
+	}
+
+	RemapConnectivity(objects.elements, old_ids, new_ids);
+	for (auto it = begin(parts); it != end(parts); ++it)
+		RemapConnectivity(it->second, old_ids, new_ids);
+
+	//drop the merged nodes from the node list
+	Nodes kept;
+	objects.node_index.clear();
+	for (size_t i = 0; i < N; ++i)
+	{
+		if (rep[i] != static_cast<int>(i)) continue;
+		kept.AddNode(static_cast<int>(n.nids[i]), n.x[i], n.y[i], n.z[i]);
+		objects.node_index[static_cast<int>(n.nids[i])] = (int)kept.nids.size() - 1;
+	}
+	objects.nodes = std::move(kept);
+	Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS, static_cast<long long>(objects.node_index.size()));
+
+	return static_cast<int>(remap.size());
+}
+
+void Print_summary(string const &name, FiniteElementObject &part)
+{
+	cout << "Part: " << name << endl;
+	cout << "  Number of nodes: " << part.nodes.nids.size() << endl;
+	cout << "  Number of elements: " << part.elements.eids.size() << endl;
+}
+
+FiniteElementObject Renumber_Nodes(FiniteElementObject const &part)
+{
+	ScopedTimer timer("Renumber_Nodes");
+	FiniteElementObject R;
+
+	map<int, int> node_remap;
+	node_remap[0] = 0; //preserve 0 for "not a node"
+	long long lookups = 1;
+
+	R.nodes.nids.resize(part.nodes.nids.size());
+	R.nodes.x.resize(part.nodes.x.size());
+	R.nodes.y.resize(part.nodes.y.size());
+	R.nodes.z.resize(part.nodes.z.size());
+
+	for (size_t j = 0; j < part.nodes.nids.size(); ++j)
+	{
+		node_remap[part.nodes.nids.at(j)] = j+1;
+		R.nodes.nids[j] = j+1;
+		R.nodes.x[j] = part.nodes.x.at(j);
+		R.nodes.y[j] = part.nodes.y.at(j);
+		R.nodes.z[j] = part.nodes.z.at(j);
+		R.node_index[j+1] = j;
+		lookups += 2;
+	}
+
+	//loop over elements, renumber nodes according to the remapping scheme.  The new element IDs are
+	//unique by construction, so the elements are appended without AddElement's search for duplicates.
+	size_t nElements = part.elements.eids.size();
+	R.elements.eids.resize(nElements);
+	R.elements.pids = part.elements.pids;
+	vector<int> const *columns[8] = { &part.elements.n1, &part.elements.n2, &part.elements.n3, &part.elements.n4,
+		&part.elements.n5, &part.elements.n6, &part.elements.n7, &part.elements.n8 };
+	vector<int> *renumbered[8] = { &R.elements.n1, &R.elements.n2, &R.elements.n3, &R.elements.n4,
+		&R.elements.n5, &R.elements.n6, &R.elements.n7, &R.elements.n8 };
+	for (int k = 0; k < 8; ++k) renumbered[k]->resize(nElements);
+	for (size_t j = 0; j < nElements; ++j)
+	{
+		R.elements.eids[j] = static_cast<int>(j + 1); //renumber elements in order of appearance
+		for (int k = 0; k < 8; ++k) (*renumbered[k])[j] = node_remap[(*columns[k])[j]];
+		lookups += 8;
+	}
+
+	Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS, lookups);
+	
+	return R;
+}
+
+bool ConfirmOverwrite(fs::path const &outfile)
+{
+	if (fs::is_regular_file(outfile)) {
+		cout << "File " << outfile.string() << " already exists. Would you like to overwrite? [y/n]";
+		char c;
+		std::cin >> c;
+		if (!(c == 'y' || c == 'Y')) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void WriteNodes(std::ostream &f, Nodes const &n)
+{
+	f.precision(16);
+	for (size_t i = 0; i < n.nids.size(); ++i) {
+		f << n.nids[i] << "\t" << n.x[i] << "\t" << n.y[i] << "\t" << n.z[i] << endl;
+	}
+}
+
+void WriteElements(std::ostream &f, Elements const &e)
+{
+	f.precision(16);
+	for (size_t i = 0; i < e.eids.size(); ++i) {
+		f << e.eids[i]
+			<< "\t" << e.n1[i]
+			<< "\t" << e.n2[i]
+			<< "\t" << e.n3[i]
+			<< "\t" << e.n4[i]
+			<< "\t" << e.n5[i]
+			<< "\t" << e.n6[i]
+			<< "\t" << e.n7[i]
+			<< "\t" << e.n8[i]
+			<< endl;
+	}
+}
+
+void OutputNodes(string const &file_name, Nodes const &n, bool overwrite)
+{
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		std::ofstream f(outfile.string());
+		WriteNodes(f, n);
+		Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(f.tellp()));
+	}
+}
+
+void OutputElements(string const &file_name, Elements const &e, bool overwrite)
+{
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		std::ofstream f(outfile.string());
+		WriteElements(f, e);
+		Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(f.tellp()));
+	}
+}
+
+void OutputToFiles(string const& base_name, FiniteElementObject const &obj, bool overwrite)
+{
+	//check that only one part is present in obj
+	vector<int> pids = obj.elements.pids;
+	std::sort(pids.begin(), pids.end());
+	pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+	if (pids.size() != 1) throw std::runtime_error("Internal error: cannot output a file for an object containing more than one part ID number.");
+
+	ScopedTimer timer("OutputToFiles");
+	OutputNodes(base_name + "-nodes.txt", obj.nodes, overwrite);
+	OutputElements(base_name + "-elements.txt", obj.elements, overwrite);
+}
+
+}
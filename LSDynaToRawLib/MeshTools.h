@@ -0,0 +1,55 @@
+// MeshTools.h : Operations on parsed meshes: part isolation, node merging, renumbering and output.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+
+namespace d2r
+{
+
+//Copies the elements of one part, and the nodes they reference, out of the global object
+FiniteElementObject IsolatePart(std::map<int, Elements> &parts,
+	FiniteElementObject &objects,
+	int pid);
+
+//As above, without modifying the global object, so that several threads may isolate parts of it at once.
+//Throws if an element refers to a node that is not defined.
+FiniteElementObject IsolatePart(FiniteElementObject const &objects, int pid);
+
+//Copies the elements at the given positions, and the nodes they reference, out of the global object
+FiniteElementObject ExtractElements(FiniteElementObject const &objects, vector<size_t> const &element_indices);
+
+//Collapses nodes that lie within tolerance of each other onto the node that appears first, and rewrites
+//the element connectivity of the global object and of every part to refer to the surviving node ids.
+//Nodes are binned into a uniform hash grid with cell size equal to the tolerance, so each node only has
+//to be compared against the nodes in its own and the 26 neighboring cells.
+//Returns the number of nodes that were removed.
+int MergeCoincidentNodes(std::map<int, Elements> &parts,
+	FiniteElementObject &objects,
+	double tolerance);
+
+void Print_summary(string const &name, FiniteElementObject &part);
+
+//Numbers the nodes and elements of a part consecutively from 1, in order of appearance
+FiniteElementObject Renumber_Nodes(FiniteElementObject const &part);
+
+//Asks the user before an existing file is overwritten; returns true if the file may be written
+bool ConfirmOverwrite(fs::path const &outfile);
+
+//Tab-separated text, one node or element per line, as in the exported files
+void WriteNodes(std::ostream &f, Nodes const &n);
+
+void WriteElements(std::ostream &f, Elements const &e);
+
+//The writers ask before replacing an existing file unless overwrite is set
+void OutputNodes(string const &file_name, Nodes const &n, bool overwrite = false);
+
+void OutputElements(string const &file_name, Elements const &e, bool overwrite = false);
+
+//Writes <base_name>-nodes.txt and <base_name>-elements.txt for an object that holds a single part
+void OutputToFiles(string const& base_name, FiniteElementObject const &obj, bool overwrite = false);
+
+}
@@ -0,0 +1,149 @@
+// Model.cpp : In-process interface to the converter.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "Model.h"
+#include "MeshTools.h"
+
+namespace d2r
+{
+
+Model::Model()
+	: merged(false)
+{}
+
+void Model::SetVerbose(bool verbose)
+{
+	kf.SetVerbose(verbose);
+}
+
+void Model::SetLegacyLexer(bool legacy_lexer)
+{
+	kf.SetLegacyLexer(legacy_lexer);
+}
+
+void Model::Append(string const &file_name)
+{
+	if (merged) throw std::logic_error("Keyfiles cannot be appended to a model after its nodes have been merged.");
+	kf.Append(file_name);
+	extracted.clear();
+}
+
+void Model::Append(string const &file_name, string const &cache_file)
+{
+	if (merged) throw std::logic_error("Keyfiles cannot be appended to a model after its nodes have been merged.");
+	kf.Append(file_name, fs::path(cache_file));
+	extracted.clear();
+}
+
+void Model::Restore(string const &cache_file)
+{
+	if (merged) throw std::logic_error("Keyfiles cannot be appended to a model after its nodes have been merged.");
+	kf.Restore(fs::path(cache_file));
+	extracted.clear();
+}
+
+FiniteElementObject const & Model::Objects() const
+{
+	return merged ? objects : kf.GetObjects();
+}
+
+int Model::MergeCoincidentNodes(double tolerance)
+{
+	//nothing can be appended after a merge, so the mesh is moved out of the KeyFile rather than copied.
+	//The parts map of the KeyFile only lists the part IDs from here on, so it is not remapped.
+	if (!merged) objects = kf.ReleaseObjects();
+	extracted.clear();
+	merged = true;
+	std::map<int, Elements> no_parts;
+	return d2r::MergeCoincidentNodes(no_parts, objects, tolerance);
+}
+
+vector<int> Model::GetPartIDs() const
+{
+	vector<int> pids;
+	for (auto it = begin(kf.GetParts()); it != end(kf.GetParts()); ++it)
+		pids.push_back(it->first);
+	return pids;
+}
+
+string Model::GetPartName(int pid) const
+{
+	auto it = kf.GetPartNames().find(pid);
+	return it == kf.GetPartNames().end() ? string() : it->second;
+}
+
+FiniteElementObject const & Model::GetObjects() const
+{
+	return Objects();
+}
+
+SetMap const & Model::GetSets() const
+{
+	return kf.GetSets();
+}
+
+void Model::CheckPart(int pid) const
+{
+	if (kf.GetParts().count(pid) == 0)
+		throw std::out_of_range("The model has no elements with part ID " + boost::lexical_cast<string>(pid));
+}
+
+FiniteElementObject Model::ExtractPart(int pid, bool renumber)
+{
+	CheckPart(pid);
+	FiniteElementObject part = IsolatePart(Objects(), pid);
+	return renumber ? Renumber_Nodes(part) : part;
+}
+
+FiniteElementObject const & Model::GetPart(int pid, bool renumber)
+{
+	auto key = std::make_pair(pid, renumber);
+	auto it = extracted.find(key);
+	if (it == extracted.end()) {
+		it = extracted.insert(std::make_pair(key, ExtractPart(pid, renumber))).first;
+	}
+	return it->second;
+}
+
+PartView Model::GetPartView(int pid, bool renumber)
+{
+	FiniteElementObject const &part = GetPart(pid, renumber);
+
+	PartView v;
+	v.pid = pid;
+	auto name = kf.GetPartNames().find(pid);
+	v.name = name == kf.GetPartNames().end() ? "" : name->second.c_str();
+
+	v.num_nodes = part.nodes.nids.size();
+	v.nids = part.nodes.nids.data();
+	v.x = part.nodes.x.data();
+	v.y = part.nodes.y.data();
+	v.z = part.nodes.z.data();
+
+	v.num_elements = part.elements.eids.size();
+	v.eids = part.elements.eids.data();
+	v.pids = part.elements.pids.data();
+	v.n[0] = part.elements.n1.data();
+	v.n[1] = part.elements.n2.data();
+	v.n[2] = part.elements.n3.data();
+	v.n[3] = part.elements.n4.data();
+	v.n[4] = part.elements.n5.data();
+	v.n[5] = part.elements.n6.data();
+	v.n[6] = part.elements.n7.data();
+	v.n[7] = part.elements.n8.data();
+	return v;
+}
+
+void Model::WritePart(int pid, string const &base_name, bool renumber, bool overwrite)
+{
+	auto it = extracted.find(std::make_pair(pid, renumber));
+	if (it != extracted.end()) {
+		OutputToFiles(base_name, it->second, overwrite);
+	}
+	else {
+		OutputToFiles(base_name, ExtractPart(pid, renumber), overwrite);
+	}
+}
+
+}
@@ -0,0 +1,86 @@
+// Model.h : In-process interface to the converter. A Model parses a set of keyfiles once and hands out
+//			 the extracted parts as views over their structure-of-arrays storage, without copies or temporary files.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include "KeyFile.h"
+
+namespace d2r
+{
+
+//Read-only view of one extracted part.  The pointers refer to arrays owned by the Model and remain valid
+//until the Model is modified (Append, MergeCoincidentNodes) or destroyed.
+struct PartView
+{
+	int pid;
+	char const *name;
+
+	size_t num_nodes;
+	double const *nids;
+	double const *x;
+	double const *y;
+	double const *z;
+
+	size_t num_elements;
+	int const *eids;
+	int const *pids;
+	int const *n[8]; //connectivity columns n1..n8; 0 marks an unused corner
+};
+
+class Model
+{
+public:
+	Model();
+
+	//Prints progress of the parse to cout; on by default
+	void SetVerbose(bool verbose);
+
+	//See KeyFile::SetLegacyLexer
+	void SetLegacyLexer(bool legacy_lexer);
+
+	void Append(string const &file_name);
+
+	//See KeyFile::Append(name, cache_file) and KeyFile::Restore
+	void Append(string const &file_name, string const &cache_file);
+
+	void Restore(string const &cache_file);
+
+	//See d2r::MergeCoincidentNodes; keyfiles cannot be appended after a merge
+	int MergeCoincidentNodes(double tolerance);
+
+	vector<int> GetPartIDs() const;
+
+	string GetPartName(int pid) const;
+
+	FiniteElementObject const & GetObjects() const;
+
+	//See KeyFile::GetSets
+	SetMap const & GetSets() const;
+
+	//Isolates a part and returns a copy, optionally renumbered from 1 as in the exported files
+	FiniteElementObject ExtractPart(int pid, bool renumber);
+
+	//Isolates a part once and keeps it in the Model, so that views of it can be handed out
+	FiniteElementObject const & GetPart(int pid, bool renumber);
+
+	PartView GetPartView(int pid, bool renumber);
+
+	void WritePart(int pid, string const &base_name, bool renumber, bool overwrite);
+
+private:
+	void CheckPart(int pid) const;
+
+	//the mesh of the KeyFile, or the mesh moved out of it once MergeCoincidentNodes has been called
+	FiniteElementObject const & Objects() const;
+
+	KeyFile										kf;
+	FiniteElementObject							objects;
+	std::map<std::pair<int, bool>, FiniteElementObject>	extracted;
+	bool										merged;
+};
+
+}
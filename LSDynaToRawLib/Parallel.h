@@ -0,0 +1,37 @@
+// Parallel.h : Minimal thread helpers used by the parallel stages of the converter.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include <thread>
+
+namespace d2r
+{
+
+//Splits the range [0, n) into one contiguous chunk per hardware thread and calls f(begin, end) on each.
+//No thread is started for fewer than grain items, so cheap loops over small ranges stay serial.
+template <typename F>
+void ParallelFor(size_t n, F f, size_t grain = 1024)
+{
+	size_t nThreads = std::max(1u, std::thread::hardware_concurrency());
+	nThreads = std::min(nThreads, std::max<size_t>(1, n / grain));
+	if (nThreads == 1) {
+		f(size_t(0), n);
+		return;
+	}
+
+	vector<std::thread> threads;
+	size_t chunk = (n + nThreads - 1) / nThreads;
+	for (size_t t = 0; t < nThreads; ++t)
+	{
+		size_t b = t * chunk;
+		size_t e = std::min(n, b + chunk);
+		if (b >= e) break;
+		threads.emplace_back(f, b, e);
+	}
+	for (auto &th : threads) th.join();
+}
+
+}
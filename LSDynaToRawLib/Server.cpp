@@ -0,0 +1,502 @@
+// Server.cpp : Resident conversion service that keeps a parsed model in memory and answers part extraction
+//				requests over a local (Unix domain) socket.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "Server.h"
+#include "KeyFile.h"
+#include "MeshTools.h"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace d2r
+{
+
+namespace
+{
+#ifdef _WIN32
+	typedef SOCKET native_socket;
+
+	const std::uintptr_t INVALID_HANDLE = static_cast<std::uintptr_t>(INVALID_SOCKET);
+	const int SEND_FLAGS = 0;
+	const int SHUTDOWN_RECEIVE = SD_RECEIVE;
+#else
+	typedef int native_socket;
+
+	const std::uintptr_t INVALID_HANDLE = static_cast<std::uintptr_t>(-1);
+#ifdef MSG_NOSIGNAL
+	const int SEND_FLAGS = MSG_NOSIGNAL; //a client that hangs up must not kill the server with SIGPIPE
+#else
+	const int SEND_FLAGS = 0;
+#endif
+	const int SHUTDOWN_RECEIVE = SHUT_RD;
+#endif
+
+	native_socket Native(std::uintptr_t s)
+	{
+		return static_cast<native_socket>(s);
+	}
+
+	void CloseSocket(std::uintptr_t s)
+	{
+#ifdef _WIN32
+		closesocket(Native(s));
+#else
+		close(Native(s));
+#endif
+	}
+
+	bool SendAll(std::uintptr_t s, char const *data, size_t size)
+	{
+		while (size > 0)
+		{
+			int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+			int sent = send(Native(s), data, chunk, SEND_FLAGS);
+			if (sent <= 0) return false;
+			data += sent;
+			size -= static_cast<size_t>(sent);
+		}
+		return true;
+	}
+
+	template <typename T>
+	void AppendBinary(string &out, T value)
+	{
+		out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+	}
+
+	bool FillAddress(sockaddr_un &address, string const &socket_path)
+	{
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (socket_path.size() >= sizeof(address.sun_path)) return false;
+		std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+		return true;
+	}
+
+	//Interrupts are noted by the handler and acted on by the thread in Run, since a handler may do
+	//next to nothing.  On Windows the console handler runs on a thread of its own and stops the server itself.
+#ifdef _WIN32
+	std::atomic<Server*> interrupted_server(nullptr);
+
+	BOOL WINAPI OnConsoleInterrupt(DWORD)
+	{
+		Server *server = interrupted_server.load();
+		if (!server) return FALSE;
+		server->Stop();
+		return TRUE;
+	}
+#else
+	volatile std::sig_atomic_t interrupted = 0;
+
+	void OnInterrupt(int)
+	{
+		interrupted = 1;
+	}
+#endif
+}
+
+Server::Server(vector<string> const &input_files_, double merge_tolerance_, bool legacy_lexer_)
+	: input_files(input_files_)
+	, merge_tolerance(merge_tolerance_)
+	, legacy_lexer(legacy_lexer_)
+	, stopping(false)
+{
+	snapshot = Load(1);
+}
+
+Server::~Server()
+{
+	Stop();
+}
+
+std::shared_ptr<ModelSnapshot const> Server::Load(long long generation) const
+{
+	ScopedTimer timer("Load");
+	KeyFile kf;
+	kf.SetVerbose(false);
+	kf.SetLegacyLexer(legacy_lexer);
+	//a reload that is overtaken by Stop is abandoned between the input files, so that Run does not wait for
+	//the rest of the parse before it returns
+	for (size_t i = 0; i < input_files.size(); ++i)
+	{
+		if (stopping) return nullptr;
+		kf.Append(input_files[i]);
+	}
+	if (stopping) return nullptr;
+
+	auto s = std::make_shared<ModelSnapshot>();
+	s->part_names = kf.GetPartNames();
+	s->generation = generation;
+	FiniteElementObject objects = kf.ReleaseObjects();
+	if (merge_tolerance > 0) {
+		std::map<int, Elements> no_parts; //the parts are isolated from the merged objects below
+		MergeCoincidentNodes(no_parts, objects, merge_tolerance);
+	}
+	s->nNodes = objects.nodes.nids.size();
+	s->nElements = objects.elements.eids.size();
+
+	//the elements of every part are found in one pass, and each part is isolated and renumbered once
+	std::map<int, vector<size_t>> part_elements;
+	for (size_t i = 0; i < objects.elements.pids.size(); ++i) part_elements[objects.elements.pids[i]].push_back(i);
+	for (auto it = begin(part_elements); it != end(part_elements); ++it)
+	{
+		FiniteElementObject part = ExtractElements(objects, it->second);
+		ServedPart &served = s->parts[it->first];
+		served.renumbered = Renumber_Nodes(part);
+		served.nids = std::move(part.nodes.nids);
+		served.eids = std::move(part.elements.eids);
+		s->pids.push_back(it->first);
+	}
+
+	cout << "Loaded " << s->nNodes << " nodes, " << s->nElements << " elements and " << s->pids.size() << " parts" << endl;
+	return s;
+}
+
+std::shared_ptr<ModelSnapshot const> Server::Snapshot() const
+{
+	std::lock_guard<std::mutex> lock(snapshot_mutex);
+	return snapshot;
+}
+
+vector<std::pair<std::time_t, uintmax_t>> Server::Stamps() const
+{
+	vector<std::pair<std::time_t, uintmax_t>> stamps;
+	for (size_t i = 0; i < input_files.size(); ++i)
+	{
+		boost::system::error_code ec;
+		std::time_t t = fs::last_write_time(input_files[i], ec);
+		uintmax_t size = fs::file_size(input_files[i], ec);
+		stamps.push_back(std::make_pair(ec ? std::time_t(0) : t, ec ? uintmax_t(0) : size));
+	}
+	return stamps;
+}
+
+void Server::Watch()
+{
+	auto last = Stamps();
+	while (!stopping)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		auto now = Stamps();
+		if (now == last) continue;
+
+		//wait for the writer to finish before parsing what it wrote
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		if (Stamps() != now) continue;
+		last = now;
+
+		try {
+			auto next = Load(Snapshot()->generation + 1);
+			if (!next) break;
+			std::lock_guard<std::mutex> lock(snapshot_mutex);
+			snapshot = next;
+			cout << "Inputs changed; reloaded the model (generation " << snapshot->generation << ")" << endl;
+		}
+		catch (std::exception &e) {
+			cout << "Inputs changed, but they could not be loaded; still serving the previous model: " << e.what() << endl;
+		}
+	}
+}
+
+string Server::HandleRequest(string const &request) const
+{
+	std::shared_ptr<ModelSnapshot const> s = Snapshot();
+	std::istringstream in(request);
+	string command;
+	in >> command;
+
+	try {
+		if (command == "list")
+		{
+			std::ostringstream out;
+			out << "OK " << s->pids.size() << "\n";
+			for (auto it = s->pids.begin(); it != s->pids.end(); ++it)
+			{
+				auto name = s->part_names.find(*it);
+				out << *it << "\t" << (name == s->part_names.end() ? string() : name->second) << "\n";
+			}
+			return out.str();
+		}
+		else if (command == "info")
+		{
+			std::ostringstream out;
+			out << "OK " << s->generation << " " << s->nNodes << " " << s->nElements << " " << s->pids.size() << "\n";
+			return out.str();
+		}
+		else if (command == "part")
+		{
+			int pid;
+			if (!(in >> pid)) return "ERROR part requires a part ID\n";
+			bool binary = false, renumber = true;
+			string option;
+			while (in >> option)
+			{
+				if (option == "tsv") binary = false;
+				else if (option == "bin") binary = true;
+				else if (option == "renumber") renumber = true;
+				else if (option == "original") renumber = false;
+				else return "ERROR unknown option " + option + "\n";
+			}
+			auto found = s->parts.find(pid);
+			if (found == s->parts.end())
+				return "ERROR the model has no elements with part ID " + std::to_string(pid) + "\n";
+
+			//the original numbering is the renumbered part with the keyfile IDs put back
+			ServedPart const &served = found->second;
+			FiniteElementObject original;
+			if (!renumber) {
+				FiniteElementObject const &R = served.renumbered;
+				original.nodes = R.nodes;
+				original.nodes.nids = served.nids;
+				original.elements.eids = served.eids;
+				original.elements.pids = R.elements.pids;
+				vector<int> const *local[8] = { &R.elements.n1, &R.elements.n2, &R.elements.n3, &R.elements.n4,
+					&R.elements.n5, &R.elements.n6, &R.elements.n7, &R.elements.n8 };
+				vector<int> *ids[8] = { &original.elements.n1, &original.elements.n2, &original.elements.n3, &original.elements.n4,
+					&original.elements.n5, &original.elements.n6, &original.elements.n7, &original.elements.n8 };
+				for (int k = 0; k < 8; ++k)
+				{
+					ids[k]->resize(local[k]->size());
+					for (size_t i = 0; i < local[k]->size(); ++i)
+					{
+						int n = (*local[k])[i];
+						(*ids[k])[i] = n == 0 ? 0 : static_cast<int>(served.nids[n - 1]);
+					}
+				}
+			}
+			FiniteElementObject const &part = renumber ? served.renumbered : original;
+
+			string nodes, elements;
+			if (binary) {
+				Nodes const &n = part.nodes;
+				nodes.reserve(n.nids.size() * 4 * sizeof(double));
+				for (size_t i = 0; i < n.nids.size(); ++i)
+				{
+					AppendBinary(nodes, n.nids[i]);
+					AppendBinary(nodes, n.x[i]);
+					AppendBinary(nodes, n.y[i]);
+					AppendBinary(nodes, n.z[i]);
+				}
+				Elements const &e = part.elements;
+				elements.reserve(e.eids.size() * 10 * sizeof(int32_t));
+				for (size_t i = 0; i < e.eids.size(); ++i)
+				{
+					int32_t row[10] = { e.eids[i], e.pids[i], e.n1[i], e.n2[i], e.n3[i], e.n4[i], e.n5[i], e.n6[i], e.n7[i], e.n8[i] };
+					elements.append(reinterpret_cast<char const*>(row), sizeof(row));
+				}
+			}
+			else {
+				std::ostringstream n, e;
+				WriteNodes(n, part.nodes);
+				WriteElements(e, part.elements);
+				nodes = n.str();
+				elements = e.str();
+			}
+			return "OK " + std::to_string(nodes.size()) + " " + std::to_string(elements.size()) + "\n" + nodes + elements;
+		}
+		return "ERROR unknown request " + command + "\n";
+	}
+	catch (std::exception &e) {
+		return string("ERROR ") + e.what() + "\n";
+	}
+}
+
+void Server::Serve(SocketHandle client)
+{
+	string pending;
+	char buffer[4096];
+	while (true)
+	{
+		int got = recv(Native(client), buffer, sizeof(buffer), 0);
+		if (got <= 0) break;
+		pending.append(buffer, static_cast<size_t>(got));
+
+		size_t eol;
+		bool open = true;
+		while (open && (eol = pending.find('\n')) != string::npos)
+		{
+			string request = pending.substr(0, eol);
+			if (!request.empty() && request.back() == '\r') request.pop_back();
+			pending.erase(0, eol + 1);
+			if (request.empty()) continue;
+
+			if (request == "shutdown") {
+				SendAll(client, "OK\n", 3);
+				Stop();
+				open = false;
+				break;
+			}
+			string response = HandleRequest(request);
+			Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(response.size()));
+			open = SendAll(client, response.data(), response.size());
+		}
+		if (!open) break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		active.erase(client);
+	}
+	CloseSocket(client);
+}
+
+void Server::Work()
+{
+	while (true)
+	{
+		SocketHandle client;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (stopping) return; //Run closes the connections still in the queue
+			client = queue.front();
+			queue.pop_front();
+			active.insert(client);
+		}
+		Serve(client);
+	}
+}
+
+void Server::Run(string const &socket_path_, size_t nThreads)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) throw std::runtime_error("Could not initialize Winsock.");
+#endif
+	sockaddr_un address;
+	if (!FillAddress(address, socket_path_)) throw std::invalid_argument("The socket path is too long: " + socket_path_);
+
+	//a socket file left behind by a server that did not shut down cleanly would make bind fail
+	boost::system::error_code ec;
+	fs::remove(socket_path_, ec);
+
+	SocketHandle listener = static_cast<SocketHandle>(socket(AF_UNIX, SOCK_STREAM, 0));
+	if (listener == INVALID_HANDLE) throw std::runtime_error("Could not create a socket.");
+	if (bind(Native(listener), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(Native(listener), 64) != 0)
+	{
+		CloseSocket(listener);
+		throw std::runtime_error("Could not listen on " + socket_path_);
+	}
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		socket_path = socket_path_;
+	}
+	cout << "Serving on " << socket_path_ << " with " << nThreads << " worker threads" << endl;
+
+#ifdef _WIN32
+	interrupted_server = this;
+	SetConsoleCtrlHandler(OnConsoleInterrupt, TRUE);
+#else
+	//the interrupts are blocked in the threads started here, so that they interrupt the accept below
+	struct sigaction on_interrupt, previous_int, previous_term;
+	std::memset(&on_interrupt, 0, sizeof(on_interrupt));
+	on_interrupt.sa_handler = OnInterrupt; //without SA_RESTART, so that accept returns
+	sigemptyset(&on_interrupt.sa_mask);
+	interrupted = 0;
+	sigaction(SIGINT, &on_interrupt, &previous_int);
+	sigaction(SIGTERM, &on_interrupt, &previous_term);
+	sigset_t interrupts, previous_mask;
+	sigemptyset(&interrupts);
+	sigaddset(&interrupts, SIGINT);
+	sigaddset(&interrupts, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &interrupts, &previous_mask);
+#endif
+
+	vector<std::thread> workers;
+	for (size_t t = 0; t < std::max<size_t>(1, nThreads); ++t) workers.emplace_back(&Server::Work, this);
+	std::thread watcher(&Server::Watch, this);
+
+#ifndef _WIN32
+	pthread_sigmask(SIG_SETMASK, &previous_mask, nullptr);
+#endif
+
+	while (!stopping)
+	{
+		SocketHandle client = static_cast<SocketHandle>(accept(Native(listener), nullptr, nullptr));
+		if (client == INVALID_HANDLE)
+		{
+#ifndef _WIN32
+			if (interrupted) {
+				cout << "Interrupted; shutting down" << endl;
+				Stop();
+				continue;
+			}
+#endif
+			//a failing accept (out of file descriptors, say) is retried after a pause rather than in a busy loop
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			continue;
+		}
+
+		//Stop wakes this loop with a connection of its own
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		if (stopping) {
+			CloseSocket(client);
+			break;
+		}
+		queue.push_back(client);
+		queue_ready.notify_one();
+	}
+
+	queue_ready.notify_all();
+	for (auto &w : workers) w.join();
+	watcher.join();
+	for (auto it = queue.begin(); it != queue.end(); ++it) CloseSocket(*it);
+	queue.clear();
+	CloseSocket(listener);
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		socket_path.clear();
+	}
+	fs::remove(socket_path_, ec);
+#ifdef _WIN32
+	SetConsoleCtrlHandler(OnConsoleInterrupt, FALSE);
+	interrupted_server = nullptr;
+	WSACleanup();
+#else
+	sigaction(SIGINT, &previous_int, nullptr);
+	sigaction(SIGTERM, &previous_term, nullptr);
+#endif
+}
+
+void Server::Stop()
+{
+	string path;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		if (stopping) return;
+		stopping = true;
+		path = socket_path;
+
+		//the connections being served finish the request in hand and then see the end of their input
+		for (auto it = active.begin(); it != active.end(); ++it) shutdown(Native(*it), SHUTDOWN_RECEIVE);
+	}
+	queue_ready.notify_all();
+
+	//a connection of our own wakes the thread blocked in accept
+	sockaddr_un address;
+	if (!path.empty() && FillAddress(address, path))
+	{
+		SocketHandle wake = static_cast<SocketHandle>(socket(AF_UNIX, SOCK_STREAM, 0));
+		if (wake != INVALID_HANDLE) {
+			connect(Native(wake), reinterpret_cast<sockaddr*>(&address), sizeof(address));
+			CloseSocket(wake);
+		}
+	}
+}
+
+}
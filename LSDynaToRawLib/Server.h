@@ -0,0 +1,107 @@
+// Server.h : Resident conversion service that keeps a parsed model in memory and answers part extraction
+//			  requests over a local (Unix domain) socket.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace d2r
+{
+
+//A part isolated and renumbered when the snapshot is built, with the keyfile IDs of its nodes and
+//elements so that requests in the original numbering need no second copy
+struct ServedPart
+{
+	FiniteElementObject		renumbered;
+	vector<double>			nids;	//keyfile ID of each node, in the order of renumbered
+	vector<int>				eids;	//keyfile ID of each element, in the order of renumbered
+};
+
+//Everything a request needs, built once per load and never modified afterwards, so that any number of
+//workers can read it without locking.  A reload builds a new snapshot; requests that are in flight keep
+//the old one alive through their shared_ptr.
+struct ModelSnapshot
+{
+	std::map<int, ServedPart>	parts;
+	std::map<int, string>		part_names;
+	vector<int>					pids;
+	size_t						nNodes;
+	size_t						nElements;
+	long long					generation;
+};
+
+//Requests are single lines of text; a connection may send any number of them.
+//  list							OK <count>, then one "<pid>\t<name>" line per part
+//  info							OK <generation> <nodes> <elements> <parts>
+//  part <pid> [tsv|bin] [renumber|original]
+//									OK <node bytes> <element bytes>, then the node and element data.  tsv is
+//									the text of the exported files; bin is four doubles (id, x, y, z) per node
+//									and ten 32-bit ints (eid, pid, n1..n8) per element.  The defaults are tsv
+//									and renumber.
+//  shutdown						OK, then the server stops: every open connection is closed after the
+//									request it is answering, and Run returns
+//Failures are answered with a single "ERROR <message>" line.
+class Server
+{
+public:
+	Server(vector<string> const &input_files, double merge_tolerance, bool legacy_lexer);
+
+	~Server();
+
+	//Listens on socket_path and serves requests with nThreads workers until Stop is called, a client
+	//sends shutdown, or the process is interrupted (SIGINT or SIGTERM; Ctrl+C or Ctrl+Break on Windows)
+	void Run(string const &socket_path, size_t nThreads);
+
+	//May be called from any thread
+	void Stop();
+
+	//Answers one request line against the current snapshot
+	string HandleRequest(string const &request) const;
+
+private:
+	typedef std::uintptr_t SocketHandle;
+
+	//Returns null if the server is stopped before the inputs have been parsed
+	std::shared_ptr<ModelSnapshot const> Load(long long generation) const;
+
+	std::shared_ptr<ModelSnapshot const> Snapshot() const;
+
+	//Modification times and sizes of the inputs, to notice edits
+	vector<std::pair<std::time_t, uintmax_t>> Stamps() const;
+
+	//Polls the inputs and swaps in a new snapshot when one of them changes
+	void Watch();
+
+	void Work();
+
+	void Serve(SocketHandle client);
+
+	vector<string>							input_files;
+	double									merge_tolerance;
+	bool									legacy_lexer;
+
+	mutable std::mutex						snapshot_mutex;
+	std::shared_ptr<ModelSnapshot const>	snapshot;
+
+	std::mutex								queue_mutex;
+	std::condition_variable					queue_ready;
+	std::deque<SocketHandle>				queue;
+	std::set<SocketHandle>					active; //connections being served
+
+	//stopping and socket_path are written under queue_mutex; the listening socket is local to Run
+	std::atomic<bool>						stopping;
+	string									socket_path;
+};
+
+}
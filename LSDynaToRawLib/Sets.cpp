@@ -0,0 +1,281 @@
+// Sets.cpp : Node, part and solid element sets read from *SET keywords, and the filtering of parts by set.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "Sets.h"
+#include "MeshTools.h"
+#include "StructuralIndex.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <cstdlib>
+#include <sstream>
+
+namespace d2r
+{
+
+namespace
+{
+	const size_t BITMAP_WORDS = 65536 / 64;
+}
+
+void IdSet::Add(int id)
+{
+	if (id <= 0) return;
+	if (Set(FindOrInsert(static_cast<uint16_t>(static_cast<uint32_t>(id) >> 16)), static_cast<uint16_t>(id & 0xFFFF))) ++count;
+}
+
+void IdSet::AddRange(int first, int last)
+{
+	first = std::max(first, 1);
+	for (int64_t high = first >> 16; high <= (last >> 16); ++high)
+	{
+		uint32_t lo = high == (first >> 16) ? (first & 0xFFFF) : 0;
+		uint32_t hi = high == (last >> 16) ? (last & 0xFFFF) : 0xFFFF;
+		if (lo > hi) continue;
+		Container &c = FindOrInsert(static_cast<uint16_t>(high));
+
+		//a long range would overflow the array anyway
+		if (c.bitmap.empty() && c.cardinality + (hi - lo + 1) > ARRAY_LIMIT) Densify(c);
+		for (uint32_t low = lo; low <= hi; ++low)
+			if (Set(c, static_cast<uint16_t>(low))) ++count;
+	}
+}
+
+void IdSet::Add(IdSet const &other)
+{
+	vector<int> ids = other.ToVector();
+	for (auto it = ids.begin(); it != ids.end(); ++it) Add(*it);
+}
+
+bool IdSet::Contains(int id) const
+{
+	if (id <= 0) return false;
+	uint16_t key = static_cast<uint16_t>(static_cast<uint32_t>(id) >> 16);
+	uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+	auto it = std::lower_bound(containers.begin(), containers.end(), key,
+		[](Container const &c, uint16_t k) { return c.key < k; });
+	if (it == containers.end() || it->key != key) return false;
+	if (!it->bitmap.empty()) return (it->bitmap[low >> 6] >> (low & 63)) & 1;
+	return std::binary_search(it->array.begin(), it->array.end(), low);
+}
+
+vector<int> IdSet::ToVector() const
+{
+	vector<int> ids;
+	ids.reserve(count);
+	for (auto c = containers.begin(); c != containers.end(); ++c)
+	{
+		int high = static_cast<int>(c->key) << 16;
+		if (c->bitmap.empty()) {
+			for (auto low = c->array.begin(); low != c->array.end(); ++low) ids.push_back(high | *low);
+			continue;
+		}
+		for (size_t w = 0; w < BITMAP_WORDS; ++w)
+			for (uint64_t bits = c->bitmap[w]; bits; bits &= bits - 1)
+				ids.push_back(high | static_cast<int>(w * 64 + CountTrailingZeros(bits)));
+	}
+	return ids;
+}
+
+IdSet::Container & IdSet::FindOrInsert(uint16_t key)
+{
+	//set cards usually list IDs in ascending order, so the last container is checked first
+	if (!containers.empty() && containers.back().key == key) return containers.back();
+	auto it = std::lower_bound(containers.begin(), containers.end(), key,
+		[](Container const &c, uint16_t k) { return c.key < k; });
+	if (it != containers.end() && it->key == key) return *it;
+	Container c;
+	c.key = key;
+	c.cardinality = 0;
+	return *containers.insert(it, c);
+}
+
+void IdSet::Densify(Container &c)
+{
+	c.bitmap.assign(BITMAP_WORDS, 0);
+	for (auto low = c.array.begin(); low != c.array.end(); ++low) c.bitmap[*low >> 6] |= uint64_t(1) << (*low & 63);
+	vector<uint16_t>().swap(c.array);
+}
+
+bool IdSet::Set(Container &c, uint16_t low)
+{
+	if (!c.bitmap.empty()) {
+		uint64_t bit = uint64_t(1) << (low & 63);
+		if (c.bitmap[low >> 6] & bit) return false;
+		c.bitmap[low >> 6] |= bit;
+		++c.cardinality;
+		return true;
+	}
+	if (c.array.empty() || c.array.back() < low) c.array.push_back(low);
+	else {
+		auto it = std::lower_bound(c.array.begin(), c.array.end(), low);
+		if (*it == low) return false;
+		c.array.insert(it, low);
+	}
+	if (++c.cardinality > ARRAY_LIMIT) Densify(c);
+	return true;
+}
+
+string SetKindName(SetKind kind)
+{
+	switch (kind) {
+	case NODE_SET: return "node";
+	case PART_SET: return "part";
+	default: return "solid";
+	}
+}
+
+bool ParseSetKeyword(string const &keyword, SetKind &kind, bool &generate, bool &titled)
+{
+	std::istringstream in(keyword);
+	string word;
+	if (!std::getline(in, word, '_') || strcmpi(word.c_str(), "SET")) return false;
+	if (!std::getline(in, word, '_')) return false;
+	if (!strcmpi(word.c_str(), "NODE")) kind = NODE_SET;
+	else if (!strcmpi(word.c_str(), "PART")) kind = PART_SET;
+	else if (!strcmpi(word.c_str(), "SOLID")) kind = SOLID_SET;
+	else return false;
+
+	generate = titled = false;
+	while (std::getline(in, word, '_'))
+	{
+		if (!strcmpi(word.c_str(), "LIST")) {}
+		else if (!strcmpi(word.c_str(), "GENERATE")) generate = true;
+		else if (!strcmpi(word.c_str(), "TITLE")) titled = true;
+		else return false;
+	}
+	return true;
+}
+
+void MergeSets(SetMap &sets, SetMap const &other)
+{
+	for (auto it = begin(other); it != end(other); ++it)
+	{
+		auto found = sets.find(it->first);
+		if (found == sets.end()) {
+			sets.insert(*it);
+			continue;
+		}
+		found->second.members.Add(it->second.members);
+		if (!it->second.title.empty()) found->second.title = it->second.title;
+	}
+}
+
+void SetFilter::Select(SetMap const &sets, string const &spec)
+{
+	//kind:id
+	int kind = -1;
+	string id_part = spec;
+	size_t colon = spec.find(':');
+	if (colon != string::npos) {
+		string prefix = spec.substr(0, colon);
+		for (int k = NODE_SET; k <= SOLID_SET; ++k)
+			if (prefix == SetKindName(static_cast<SetKind>(k))) kind = k;
+		if (kind >= 0) id_part = spec.substr(colon + 1);
+	}
+
+	char *stop;
+	long sid = std::strtol(id_part.c_str(), &stop, 10);
+	bool numeric = !id_part.empty() && *stop == '\0';
+
+	vector<EntitySet const*> matches;
+	for (auto it = begin(sets); it != end(sets); ++it)
+	{
+		EntitySet const &s = it->second;
+		if (numeric && s.sid == sid && (kind < 0 || s.kind == kind)) matches.push_back(&s);
+		else if (!numeric && kind < 0 && s.title == spec) matches.push_back(&s);
+	}
+	//a title that happens to be a number
+	if (matches.empty() && numeric && kind < 0) {
+		for (auto it = begin(sets); it != end(sets); ++it)
+			if (it->second.title == spec) matches.push_back(&it->second);
+	}
+
+	if (matches.empty()) throw std::invalid_argument("The model has no set " + spec);
+	if (matches.size() > 1) throw std::invalid_argument("More than one set matches " + spec + "; give the kind of set as node:<id>, part:<id> or solid:<id>");
+	selected.push_back(*matches.front());
+}
+
+bool SetFilter::AcceptsPart(int pid) const
+{
+	for (auto it = selected.begin(); it != selected.end(); ++it)
+		if (it->kind == PART_SET && !it->members.Contains(pid)) return false;
+	return true;
+}
+
+bool SetFilter::Accepts(Elements const &e, size_t i) const
+{
+	for (auto it = selected.begin(); it != selected.end(); ++it)
+	{
+		IdSet const &members = it->members;
+		switch (it->kind) {
+		case PART_SET:
+			if (!members.Contains(e.pids[i])) return false;
+			break;
+		case SOLID_SET:
+			if (!members.Contains(e.eids[i])) return false;
+			break;
+		case NODE_SET: {
+			int nids[8] = { e.n1[i], e.n2[i], e.n3[i], e.n4[i], e.n5[i], e.n6[i], e.n7[i], e.n8[i] };
+			for (int k = 0; k < 8; ++k)
+				if (nids[k] != 0 && !members.Contains(nids[k])) return false;
+			break;
+		}
+		}
+	}
+	return true;
+}
+
+vector<size_t> SetFilter::Filter(Elements const &e) const
+{
+	ScopedTimer timer("FilterBySet");
+	size_t n = e.eids.size();
+	vector<char> pass(n);
+	ParallelFor(n, [&](size_t b, size_t end_) {
+		for (size_t i = b; i < end_; ++i) pass[i] = Accepts(e, i);
+	});
+	vector<size_t> kept;
+	for (size_t i = 0; i < n; ++i)
+		if (pass[i]) kept.push_back(i);
+	return kept;
+}
+
+void WriteSetMembership(std::ostream &f, FiniteElementObject const &obj, SetMap const &sets)
+{
+	for (auto it = begin(sets); it != end(sets); ++it)
+	{
+		EntitySet const &s = it->second;
+		vector<size_t> local;
+		bool member = false;
+		if (s.kind == NODE_SET) {
+			for (size_t j = 0; j < obj.nodes.nids.size(); ++j)
+				if (s.members.Contains(static_cast<int>(obj.nodes.nids[j]))) local.push_back(j + 1);
+			member = !local.empty();
+		}
+		else if (s.kind == SOLID_SET) {
+			for (size_t j = 0; j < obj.elements.eids.size(); ++j)
+				if (s.members.Contains(obj.elements.eids[j])) local.push_back(j + 1);
+			member = !local.empty();
+		}
+		else {
+			member = !obj.elements.pids.empty() && s.members.Contains(obj.elements.pids.front());
+		}
+		if (!member) continue;
+
+		f << SetKindName(s.kind) << "\t" << s.sid << "\t" << s.title << endl;
+		for (auto id = local.begin(); id != local.end(); ++id) f << *id << endl;
+	}
+}
+
+void OutputSetMembership(string const &file_name, FiniteElementObject const &obj, SetMap const &sets, bool overwrite)
+{
+	fs::path outfile = fs::path(file_name);
+	if (overwrite || ConfirmOverwrite(outfile))
+	{
+		std::ofstream f(outfile.string());
+		WriteSetMembership(f, obj, sets);
+		Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(f.tellp()));
+	}
+}
+
+}
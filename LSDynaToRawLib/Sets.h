@@ -0,0 +1,126 @@
+// Sets.h : Node, part and solid element sets read from *SET keywords, and the filtering of parts by set.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <cstdint>
+
+namespace d2r
+{
+
+//Compressed bitmap of positive IDs, in the manner of a roaring bitmap: the IDs are grouped by their
+//upper 16 bits, and each group is stored as a sorted array of the lower 16 bits while it is small and
+//as a 65536 bit bitmap once it is not.  Sparse sets with scattered IDs stay small, and dense ranges
+//cost one bit per ID.
+class IdSet
+{
+public:
+	IdSet() : count(0) {}
+
+	//IDs that are zero or negative are ignored, as blank fields are in the set cards
+	void Add(int id);
+
+	//Adds first through last, inclusive
+	void AddRange(int first, int last);
+
+	void Add(IdSet const &other);
+
+	bool Contains(int id) const;
+
+	size_t Size() const
+	{
+		return count;
+	}
+
+	//The IDs in ascending order
+	vector<int> ToVector() const;
+
+private:
+	static const size_t ARRAY_LIMIT = 4096;
+
+	struct Container
+	{
+		uint16_t key;
+		size_t cardinality;
+		vector<uint16_t> array;		//sorted low bits while cardinality <= ARRAY_LIMIT
+		vector<uint64_t> bitmap;	//1024 words once the group is dense; array is then empty
+	};
+
+	Container & FindOrInsert(uint16_t key);
+
+	//Converts an array container to a bitmap container
+	static void Densify(Container &c);
+
+	static bool Set(Container &c, uint16_t low);
+
+	vector<Container>	containers; //sorted by key
+	size_t				count;
+};
+
+enum SetKind
+{
+	NODE_SET = 0,
+	PART_SET = 1,
+	SOLID_SET = 2
+};
+
+struct EntitySet
+{
+	SetKind kind;
+	int sid;
+	string title; //empty unless the set was read from a _TITLE keyword
+	IdSet members;
+};
+
+//Set IDs are only unique within one kind of set, so sets are keyed by kind and then ID
+typedef std::map<std::pair<int, int>, EntitySet> SetMap;
+
+//"node", "part" or "solid"
+string SetKindName(SetKind kind);
+
+//Recognizes SET_NODE, SET_PART and SET_SOLID with any of the options _LIST, _GENERATE and _TITLE.
+//Other set keywords (_ADD, _GENERAL, _COLUMN, ...) are not recognized and are skipped by the parser.
+bool ParseSetKeyword(string const &keyword, SetKind &kind, bool &generate, bool &titled);
+
+//Adds the sets of other to sets; members of a set defined in both are combined
+void MergeSets(SetMap &sets, SetMap const &other);
+
+//Elements pass when they pass every selected set.  A part set tests the part ID of the element, a solid
+//set its element ID, and a node set requires every node of the element to be in the set.
+class SetFilter
+{
+public:
+	//Selects a set by ID, by kind and ID (node:3, part:2, solid:5) or by title.  Throws if nothing
+	//matches, or if more than one set does.
+	void Select(SetMap const &sets, string const &spec);
+
+	bool Empty() const
+	{
+		return selected.empty();
+	}
+
+	//False if a selected part set excludes the whole part
+	bool AcceptsPart(int pid) const;
+
+	bool Accepts(Elements const &e, size_t i) const;
+
+	//Positions of the elements that pass, in ascending order; tested in parallel
+	vector<size_t> Filter(Elements const &e) const;
+
+private:
+	vector<EntitySet> selected;
+};
+
+//Writes the membership of a part in every set that includes some of it.  Each set is a line
+//"<kind>\t<sid>\t<title>" followed by the members, one per line, as local node or element numbers of
+//the renumbered part (its position, from 1, in obj).  Part sets have no member lines; the whole part
+//belongs to them.
+void OutputSetMembership(string const &file_name, FiniteElementObject const &obj, SetMap const &sets, bool overwrite = false);
+
+//The text of OutputSetMembership, which --incremental also hashes to tell whether a part's sets changed
+void WriteSetMembership(std::ostream &f, FiniteElementObject const &obj, SetMap const &sets);
+
+}
@@ -0,0 +1,262 @@
+// SpatialIndex.cpp : Bounding volume hierarchy over element bounds, for selecting the elements in a region.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "SpatialIndex.h"
+#include "Parallel.h"
+#include "Instrumentation.h"
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <boost/lexical_cast.hpp>
+
+namespace d2r
+{
+
+namespace
+{
+	const size_t LEAF_SIZE = 4;
+
+	//Subtrees smaller than this are built on the calling thread
+	const size_t PARALLEL_BUILD_THRESHOLD = 16384;
+
+	double Centroid(AABB const &b, int axis)
+	{
+		return 0.5 * (b.lo[axis] + b.hi[axis]);
+	}
+}
+
+Region Region::Parse(string const &spec)
+{
+	size_t colon = spec.find(':');
+	string kind = spec.substr(0, colon);
+	vector<double> values;
+	if (colon != string::npos) {
+		std::istringstream in(spec.substr(colon + 1));
+		string field;
+		while (std::getline(in, field, ','))
+			values.push_back(boost::lexical_cast<double>(field));
+	}
+
+	Region r;
+	std::fill(std::begin(r.p), std::end(r.p), 0.0);
+	if (kind == "box" && values.size() == 6) {
+		r.kind = BOX;
+		for (int d = 0; d < 3; ++d) {
+			r.p[d] = std::min(values[d], values[d + 3]);
+			r.p[d + 3] = std::max(values[d], values[d + 3]);
+		}
+	}
+	else if (kind == "sphere" && values.size() == 4) {
+		r.kind = SPHERE;
+		std::copy(values.begin(), values.end(), r.p);
+	}
+	else if (kind == "slab" && values.size() == 5) {
+		r.kind = SLAB;
+		double length = std::sqrt(values[0] * values[0] + values[1] * values[1] + values[2] * values[2]);
+		if (length == 0) throw std::invalid_argument("The normal of a slab region cannot be zero.");
+		for (int d = 0; d < 3; ++d) r.p[d] = values[d] / length;
+		r.p[3] = std::min(values[3], values[4]);
+		r.p[4] = std::max(values[3], values[4]);
+	}
+	else {
+		throw std::invalid_argument("Regions are box:xmin,ymin,zmin,xmax,ymax,zmax or sphere:cx,cy,cz,r or slab:nx,ny,nz,d0,d1, not " + spec);
+	}
+	return r;
+}
+
+bool Region::Contains(double x, double y, double z) const
+{
+	switch (kind) {
+	case BOX:
+		return x >= p[0] && y >= p[1] && z >= p[2] && x <= p[3] && y <= p[4] && z <= p[5];
+	case SPHERE:
+		return (x - p[0]) * (x - p[0]) + (y - p[1]) * (y - p[1]) + (z - p[2]) * (z - p[2]) <= p[3] * p[3];
+	default: {
+		double d = p[0] * x + p[1] * y + p[2] * z;
+		return d >= p[3] && d <= p[4];
+	}
+	}
+}
+
+bool Region::Overlaps(AABB const &b) const
+{
+	switch (kind) {
+	case BOX:
+		for (int d = 0; d < 3; ++d)
+			if (b.hi[d] < p[d] || b.lo[d] > p[d + 3]) return false;
+		return true;
+	case SPHERE: {
+		double d2 = 0;
+		for (int d = 0; d < 3; ++d)
+		{
+			double c = std::max(b.lo[d], std::min(p[d], b.hi[d])); //closest point of the box to the center
+			d2 += (c - p[d]) * (c - p[d]);
+		}
+		return d2 <= p[3] * p[3];
+	}
+	default: {
+		//the projection of the box onto the normal is its center's projection plus or minus its extent
+		double center = 0, extent = 0;
+		for (int d = 0; d < 3; ++d)
+		{
+			center += p[d] * 0.5 * (b.lo[d] + b.hi[d]);
+			extent += std::abs(p[d]) * 0.5 * (b.hi[d] - b.lo[d]);
+		}
+		return center + extent >= p[3] && center - extent <= p[4];
+	}
+	}
+}
+
+ElementBVH::ElementBVH(FiniteElementObject const &objects_)
+	: objects(objects_)
+{
+	ScopedTimer timer("BuildBVH");
+	size_t n = objects.elements.eids.size();
+	if (n > std::numeric_limits<uint32_t>::max()) throw std::length_error("Too many elements for the spatial index.");
+	corners.resize(8 * n);
+	bounds.resize(n);
+	order.resize(n);
+
+	vector<int> const *columns[8] = { &objects.elements.n1, &objects.elements.n2, &objects.elements.n3, &objects.elements.n4,
+		&objects.elements.n5, &objects.elements.n6, &objects.elements.n7, &objects.elements.n8 };
+	ParallelFor(n, [&](size_t b, size_t e) {
+		long long lookups = 0;
+		for (size_t i = b; i < e; ++i)
+		{
+			AABB &box = bounds[i];
+			for (int d = 0; d < 3; ++d) {
+				box.lo[d] = std::numeric_limits<double>::infinity();
+				box.hi[d] = -std::numeric_limits<double>::infinity();
+			}
+			for (int k = 0; k < 8; ++k)
+			{
+				int nid = (*columns[k])[i];
+				auto it = nid == 0 ? objects.node_index.end() : objects.node_index.find(nid);
+				int32_t position = it == objects.node_index.end() ? -1 : it->second;
+				lookups += nid != 0;
+				corners[8 * i + k] = position;
+				if (position < 0) continue;
+				double xyz[3] = { objects.nodes.x[position], objects.nodes.y[position], objects.nodes.z[position] };
+				for (int d = 0; d < 3; ++d) {
+					box.lo[d] = std::min(box.lo[d], xyz[d]);
+					box.hi[d] = std::max(box.hi[d], xyz[d]);
+				}
+			}
+			order[i] = static_cast<uint32_t>(i);
+		}
+		Instrumentation::Get().Count(Instrumentation::MAP_LOOKUPS, lookups);
+	});
+
+	if (n > 0) CountSubtrees(n);
+	nodes.resize(n == 0 ? 0 : subtree_sizes[n]);
+	if (n > 0) Build(0, 0, n, 0);
+}
+
+void ElementBVH::CountSubtrees(size_t count)
+{
+	//the halves of a range differ by at most one element, so each level of the tree has ranges of at most
+	//two lengths and only those few sizes are ever computed
+	if (subtree_sizes.count(count)) return;
+	size_t size = 1;
+	if (count > LEAF_SIZE)
+	{
+		CountSubtrees(count / 2);
+		CountSubtrees(count - count / 2);
+		size += subtree_sizes[count / 2] + subtree_sizes[count - count / 2];
+	}
+	subtree_sizes[count] = size;
+}
+
+void ElementBVH::Build(size_t node, size_t begin, size_t end, int depth)
+{
+	BVHNode &N = nodes[node];
+	AABB box, centroids;
+	for (int d = 0; d < 3; ++d) {
+		box.lo[d] = centroids.lo[d] = std::numeric_limits<double>::infinity();
+		box.hi[d] = centroids.hi[d] = -std::numeric_limits<double>::infinity();
+	}
+	for (size_t i = begin; i < end; ++i)
+	{
+		AABB const &b = bounds[order[i]];
+		for (int d = 0; d < 3; ++d) {
+			box.lo[d] = std::min(box.lo[d], b.lo[d]);
+			box.hi[d] = std::max(box.hi[d], b.hi[d]);
+			centroids.lo[d] = std::min(centroids.lo[d], Centroid(b, d));
+			centroids.hi[d] = std::max(centroids.hi[d], Centroid(b, d));
+		}
+	}
+	N.bounds = box;
+
+	size_t count = end - begin;
+	if (count <= LEAF_SIZE) {
+		N.first = static_cast<uint32_t>(begin);
+		N.count = static_cast<uint32_t>(count);
+		N.right = 0;
+		return;
+	}
+
+	int axis = 0;
+	for (int d = 1; d < 3; ++d)
+		if (centroids.hi[d] - centroids.lo[d] > centroids.hi[axis] - centroids.lo[axis]) axis = d;
+
+	size_t mid = begin + count / 2;
+	std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+		[&](uint32_t a, uint32_t b) { return Centroid(bounds[a], axis) < Centroid(bounds[b], axis); });
+
+	size_t left = node + 1;
+	size_t right = left + subtree_sizes.at(mid - begin);
+	N.first = 0;
+	N.count = 0;
+	N.right = static_cast<uint32_t>(right);
+
+	//the two halves touch disjoint ranges of order and nodes, so they can be built at the same time
+	size_t nThreads = std::max(1u, std::thread::hardware_concurrency());
+	if (count >= PARALLEL_BUILD_THRESHOLD && (size_t(1) << depth) < nThreads) {
+		std::thread t(&ElementBVH::Build, this, left, begin, mid, depth + 1);
+		Build(right, mid, end, depth + 1);
+		t.join();
+	}
+	else {
+		Build(left, begin, mid, depth + 1);
+		Build(right, mid, end, depth + 1);
+	}
+}
+
+vector<size_t> ElementBVH::Query(Region const &region) const
+{
+	ScopedTimer timer("QueryBVH");
+	vector<size_t> found;
+	if (nodes.empty()) return found;
+
+	vector<size_t> stack(1, 0);
+	while (!stack.empty())
+	{
+		BVHNode const &N = nodes[stack.back()];
+		size_t index = stack.back();
+		stack.pop_back();
+		if (!region.Overlaps(N.bounds)) continue;
+
+		if (N.count == 0) {
+			stack.push_back(N.right);
+			stack.push_back(index + 1);
+			continue;
+		}
+		for (size_t i = N.first; i < N.first + N.count; ++i)
+		{
+			size_t element = order[i];
+			for (int k = 0; k < 8; ++k)
+			{
+				int32_t position = corners[8 * element + k];
+				if (position >= 0 && region.Contains(objects.nodes.x[position], objects.nodes.y[position], objects.nodes.z[position])) {
+					found.push_back(element);
+					break;
+				}
+			}
+		}
+	}
+	std::sort(found.begin(), found.end());
+	return found;
+}
+
+}
@@ -0,0 +1,72 @@
+// SpatialIndex.h : Bounding volume hierarchy over element bounds, for selecting the elements in a region.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "Mesh.h"
+#include <cstdint>
+
+namespace d2r
+{
+
+struct AABB
+{
+	double lo[3];
+	double hi[3];
+};
+
+//A region of space, parsed from one of
+//  box:xmin,ymin,zmin,xmax,ymax,zmax
+//  sphere:cx,cy,cz,radius
+//  slab:nx,ny,nz,d0,d1			the points whose distance along the normal n lies in [d0, d1]
+struct Region
+{
+	enum Kind { BOX, SPHERE, SLAB };
+
+	static Region Parse(string const &spec);
+
+	bool Contains(double x, double y, double z) const;
+
+	//False only if no point of the box can be in the region
+	bool Overlaps(AABB const &b) const;
+
+	Kind kind;
+	double p[6];
+};
+
+//Elements are binned by the centroid of their bounds and split at the median along the longest axis,
+//so the tree is balanced and its layout is known before it is built.  That lets the two halves of
+//every large subtree be built on separate threads, each writing its own range of the node array.
+class ElementBVH
+{
+public:
+	ElementBVH(FiniteElementObject const &objects);
+
+	//Indices, in ascending order, of the elements that have at least one node inside the region
+	vector<size_t> Query(Region const &region) const;
+
+private:
+	struct BVHNode
+	{
+		AABB bounds;
+		uint32_t first; //leaves: first position in order
+		uint32_t count; //leaves: number of elements; 0 for inner nodes
+		uint32_t right; //inner nodes: index of the right child; the left child follows its parent
+	};
+
+	//Fills subtree_sizes with the number of nodes in the subtree over count elements, and in its subtrees
+	void CountSubtrees(size_t count);
+
+	void Build(size_t node, size_t begin, size_t end, int depth);
+
+	FiniteElementObject const		&objects;
+	vector<int32_t>					corners; //8 node positions per element, -1 for unused corners
+	vector<AABB>					bounds;
+	vector<uint32_t>				order;
+	vector<BVHNode>					nodes;
+	std::map<size_t, size_t>		subtree_sizes; //by element count; read-only while the tree is built
+};
+
+}
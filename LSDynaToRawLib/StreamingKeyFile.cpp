@@ -0,0 +1,252 @@
+// StreamingKeyFile.cpp : Out-of-core, two-pass conversion for models that are larger than memory.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include "StreamingKeyFile.h"
+#include "MeshTools.h"
+#include "Instrumentation.h"
+#include <queue>
+#include <unordered_map>
+#include <functional>
+
+namespace d2r
+{
+
+void StreamingKeyFile::Convert(string const &output_base)
+{
+	if (!node_buffer.empty()) FlushNodeRun();
+	FlushElements();
+	MergeNodeRuns();
+
+	//group parts so that the node tables of one batch stay within the memory limit; a part references
+	//at most eight nodes per element, and each referenced node costs about 80 bytes while it is joined
+	const size_t bytes_per_node = 80;
+	auto part_names = GetPartNames();
+	ProgressReporter &progress = ProgressReporter::Get();
+	long long nParts = static_cast<long long>(element_counts.size()), nDone = 0;
+	vector<int> batch;
+	size_t batch_bytes = 0;
+	for (auto it = begin(element_counts); it != end(element_counts); ++it)
+	{
+		size_t part_bytes = 8 * static_cast<size_t>(it->second) * bytes_per_node;
+		if (!batch.empty() && batch_bytes + part_bytes > memory_limit) {
+			nDone += static_cast<long long>(batch.size());
+			ConvertBatch(batch, part_names, output_base);
+			progress.Update("write", nDone, nParts, part_names[batch.back()], false);
+			batch.clear();
+			batch_bytes = 0;
+		}
+		batch.push_back(it->first);
+		batch_bytes += part_bytes;
+	}
+	if (!batch.empty()) {
+		ConvertBatch(batch, part_names, output_base);
+	}
+	progress.Update("write", nParts, nParts, "", false);
+}
+
+void StreamingKeyFile::PrintParseSummary()
+{
+	cout << "Total number of nodes: " << nodes_read << endl;
+	cout << "Total number of elements: " << elements_read << endl;
+
+	auto const &part_names = GetPartNames();
+	cout << "Parts with elements found: " << endl;
+	for (auto it = begin(element_counts); it != end(element_counts); ++it)
+	{
+		auto name = part_names.find(it->first);
+		cout << "Part: " << (name == part_names.end() ? string() : name->second) << endl;
+	}
+}
+
+void StreamingKeyFile::StoreNode(int nid, double x, double y, double z)
+{
+	NodeRecord r;
+	r.nid = nid;
+	r.pad = 0;
+	r.x = x;
+	r.y = y;
+	r.z = z;
+	node_buffer.push_back(r);
+	nodes_read += 1;
+	if (node_buffer.size() >= max_buffered_nodes) FlushNodeRun();
+}
+
+void StreamingKeyFile::StoreElement(int eid, int pid, int const (&nids)[8])
+{
+	ElementRecord r;
+	r.eid = eid;
+	r.pid = pid;
+	std::copy(begin(nids), end(nids), begin(r.n));
+	part_buffers[pid].push_back(r);
+	element_counts[pid] += 1;
+	elements_read += 1;
+	if (++buffered_elements >= max_buffered_elements) FlushElements();
+}
+
+void StreamingKeyFile::FlushNodeRun()
+{
+	ScopedTimer timer("Stream: spill nodes");
+	std::stable_sort(begin(node_buffer), end(node_buffer),
+		[](NodeRecord const &a, NodeRecord const &b) { return a.nid < b.nid; });
+	fs::path run = temp_dir / ("nodes-" + boost::lexical_cast<string>(node_runs.size()) + ".run");
+	std::ofstream f(run.string(), std::ios_base::out | std::ios_base::binary);
+	f.write(reinterpret_cast<char const*>(node_buffer.data()), node_buffer.size() * sizeof(NodeRecord));
+	if (f.fail()) throw std::runtime_error("Could not write temporary file " + run.string());
+	node_runs.push_back(run);
+	vector<NodeRecord>().swap(node_buffer);
+}
+
+void StreamingKeyFile::FlushElements()
+{
+	ScopedTimer timer("Stream: spill elements");
+	for (auto it = begin(part_buffers); it != end(part_buffers); ++it)
+	{
+		if (it->second.empty()) continue;
+		fs::path file = PartFile(it->first);
+		std::ofstream f(file.string(), std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+		f.write(reinterpret_cast<char const*>(it->second.data()), it->second.size() * sizeof(ElementRecord));
+		if (f.fail()) throw std::runtime_error("Could not write temporary file " + file.string());
+	}
+	part_buffers.clear();
+	buffered_elements = 0;
+}
+
+void StreamingKeyFile::MergeNodeRuns()
+{
+	ScopedTimer timer("Stream: merge nodes");
+	typedef std::pair<int, size_t> HeapEntry; //(node id, run) - ties pop in run order, so later runs win
+	std::priority_queue<HeapEntry, vector<HeapEntry>, std::greater<HeapEntry>> heap;
+	vector<std::unique_ptr<std::ifstream>> runs;
+	vector<NodeRecord> heads(node_runs.size());
+	for (size_t k = 0; k < node_runs.size(); ++k)
+	{
+		runs.push_back(std::make_unique<std::ifstream>(node_runs[k].string(), std::ios_base::in | std::ios_base::binary));
+		if (runs[k]->read(reinterpret_cast<char*>(&heads[k]), sizeof(NodeRecord)))
+			heap.push(std::make_pair(heads[k].nid, k));
+	}
+
+	std::ofstream out(SortedNodeFile().string(), std::ios_base::out | std::ios_base::binary);
+	bool pending = false;
+	NodeRecord last;
+	while (!heap.empty())
+	{
+		size_t k = heap.top().second;
+		heap.pop();
+		if (pending && heads[k].nid != last.nid) {
+			out.write(reinterpret_cast<char const*>(&last), sizeof(NodeRecord));
+		}
+		last = heads[k];
+		pending = true;
+		if (runs[k]->read(reinterpret_cast<char*>(&heads[k]), sizeof(NodeRecord)))
+			heap.push(std::make_pair(heads[k].nid, k));
+	}
+	if (pending) out.write(reinterpret_cast<char const*>(&last), sizeof(NodeRecord));
+	if (out.fail()) throw std::runtime_error("Could not write temporary file " + SortedNodeFile().string());
+
+	runs.clear();
+	for (auto const &run : node_runs) fs::remove(run);
+	node_runs.clear();
+}
+
+void StreamingKeyFile::ConvertBatch(vector<int> const &batch, map<int, string> &part_names, string const &output_base)
+{
+	ScopedTimer timer("Stream: write parts");
+	vector<PartTable> tables(batch.size());
+
+	//stream each part's elements straight to its output file, numbering nodes as they first appear
+	for (size_t p = 0; p < batch.size(); ++p)
+	{
+		PartTable &t = tables[p];
+		t.pid = batch[p];
+		t.nElements = 0;
+		std::unordered_map<int, int> local;
+		local[0] = 0; //preserve 0 for "not a node"
+
+		fs::path outfile = fs::path(output_base + "-" + part_names[t.pid] + "-elements.txt");
+		std::ofstream out;
+		if (ConfirmOverwrite(outfile)) {
+			out.open(outfile.string());
+			out.precision(16);
+		}
+
+		std::ifstream in(PartFile(t.pid).string(), std::ios_base::in | std::ios_base::binary);
+		vector<ElementRecord> chunk(std::max<size_t>(1, max_buffered_elements));
+		while (in)
+		{
+			in.read(reinterpret_cast<char*>(chunk.data()), chunk.size() * sizeof(ElementRecord));
+			size_t n = static_cast<size_t>(in.gcount()) / sizeof(ElementRecord);
+			for (size_t i = 0; i < n; ++i)
+			{
+				ElementRecord const &r = chunk[i];
+				int renumbered[8];
+				for (int j = 0; j < 8; ++j)
+				{
+					auto it = local.find(r.n[j]);
+					if (it == local.end()) {
+						t.nids.push_back(r.n[j]);
+						it = local.insert(std::make_pair(r.n[j], static_cast<int>(t.nids.size()))).first;
+					}
+					renumbered[j] = it->second;
+				}
+				t.nElements += 1;
+				if (out.is_open()) {
+					out << t.nElements;
+					for (int j = 0; j < 8; ++j) out << "\t" << renumbered[j];
+					out << "\n";
+				}
+			}
+		}
+		if (out.is_open()) Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(out.tellp()));
+	}
+
+	//gather coordinates for every node of the batch in one pass over the sorted node file
+	vector<std::tuple<int, size_t, size_t>> wanted; //(node id, part, local index)
+	for (size_t p = 0; p < tables.size(); ++p)
+	{
+		PartTable &t = tables[p];
+		t.x.resize(t.nids.size());
+		t.y.resize(t.nids.size());
+		t.z.resize(t.nids.size());
+		for (size_t j = 0; j < t.nids.size(); ++j) wanted.push_back(make_tuple(t.nids[j], p, j));
+	}
+	std::sort(begin(wanted), end(wanted));
+
+	std::ifstream nodes(SortedNodeFile().string(), std::ios_base::in | std::ios_base::binary);
+	NodeRecord r;
+	bool have = static_cast<bool>(nodes.read(reinterpret_cast<char*>(&r), sizeof(NodeRecord)));
+	for (auto const &w : wanted)
+	{
+		while (have && r.nid < get<0>(w))
+			have = static_cast<bool>(nodes.read(reinterpret_cast<char*>(&r), sizeof(NodeRecord)));
+		if (!have || r.nid != get<0>(w)) {
+			throw std::runtime_error("Part " + part_names[tables[get<1>(w)].pid]
+				+ " references node " + boost::lexical_cast<string>(get<0>(w)) + ", which is not defined in the input.");
+		}
+		PartTable &t = tables[get<1>(w)];
+		t.x[get<2>(w)] = r.x;
+		t.y[get<2>(w)] = r.y;
+		t.z[get<2>(w)] = r.z;
+	}
+
+	for (auto const &t : tables)
+	{
+		fs::path outfile = fs::path(output_base + "-" + part_names[t.pid] + "-nodes.txt");
+		if (ConfirmOverwrite(outfile))
+		{
+			std::ofstream out(outfile.string());
+			out.precision(16);
+			for (size_t j = 0; j < t.nids.size(); ++j) {
+				out << j + 1 << "\t" << t.x[j] << "\t" << t.y[j] << "\t" << t.z[j] << "\n";
+			}
+			Instrumentation::Get().Count(Instrumentation::BYTES_WRITTEN, static_cast<long long>(out.tellp()));
+		}
+
+		cout << "Part: " << part_names[t.pid] << endl;
+		cout << "  Number of nodes: " << t.nids.size() << endl;
+		cout << "  Number of elements: " << t.nElements << endl;
+		fs::remove(PartFile(t.pid));
+	}
+}
+
+}
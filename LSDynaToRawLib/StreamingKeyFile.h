@@ -0,0 +1,114 @@
+// StreamingKeyFile.h : Out-of-core, two-pass conversion for models that are larger than memory.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include "KeyFile.h"
+
+namespace d2r
+{
+
+//Out-of-core conversion for models that do not fit in memory.
+//
+//The first pass streams the keyfiles and never keeps the model: node cards are collected into runs that are
+//sorted by node id and spilled to disk, and element cards are appended to one binary file per part, whenever
+//the buffers reach their share of the memory limit.  Convert() then merges the node runs into a single file
+//sorted by node id and, for batches of parts whose node tables fit in the memory limit, streams each part's
+//elements to the output (renumbering nodes in order of first appearance, as Renumber_Nodes does) while
+//joining the referenced nodes against the sorted node file in a single sequential scan.
+class StreamingKeyFile : public KeyFile
+{
+	typedef std::string string;
+public:
+	StreamingKeyFile(fs::path const &temp_dir_, size_t memory_limit_)
+		: temp_dir(temp_dir_)
+		, memory_limit(memory_limit_)
+		, nodes_read(0)
+		, elements_read(0)
+		, buffered_elements(0)
+	{
+		fs::create_directories(temp_dir);
+		max_buffered_nodes = std::max<size_t>(1024, memory_limit / 2 / sizeof(NodeRecord));
+		max_buffered_elements = std::max<size_t>(1024, memory_limit / 4 / sizeof(ElementRecord));
+	}
+
+	~StreamingKeyFile()
+	{
+		boost::system::error_code ec;
+		fs::remove_all(temp_dir, ec);
+	}
+
+	void Convert(string const &output_base);
+
+protected:
+	struct NodeRecord
+	{
+		int nid;
+		int pad;
+		double x;
+		double y;
+		double z;
+	};
+
+	struct ElementRecord
+	{
+		int eid;
+		int pid;
+		int n[8];
+	};
+
+	//a part that is being written: its local node numbering and the gathered coordinates
+	struct PartTable
+	{
+		int pid;
+		vector<int> nids; //global node ids, in local order
+		vector<double> x;
+		vector<double> y;
+		vector<double> z;
+		long long nElements;
+	};
+
+	void PrintParseSummary() override;
+
+	void StoreNode(int nid, double x, double y, double z) override;
+
+	void StoreElement(int eid, int pid, int const (&nids)[8]) override;
+
+	fs::path PartFile(int pid) const
+	{
+		return temp_dir / ("part-" + boost::lexical_cast<string>(pid) + ".elements");
+	}
+
+	fs::path SortedNodeFile() const
+	{
+		return temp_dir / "nodes.sorted";
+	}
+
+	//Sorts the buffered nodes by id and spills them as a run; the sort is stable so that a node
+	//defined twice keeps its file order, and the last definition wins as it does in KeyFile
+	void FlushNodeRun();
+
+	void FlushElements();
+
+	//k-way merge of the sorted runs into one file with a single record per node id
+	void MergeNodeRuns();
+
+	void ConvertBatch(vector<int> const &batch, map<int, string> &part_names, string const &output_base);
+
+private:
+	fs::path						temp_dir;
+	size_t							memory_limit;
+	size_t							max_buffered_nodes;
+	size_t							max_buffered_elements;
+	long long						nodes_read;
+	long long						elements_read;
+	size_t							buffered_elements;
+	vector<NodeRecord>				node_buffer;
+	vector<fs::path>				node_runs;
+	map<int, vector<ElementRecord>>	part_buffers;
+	map<int, long long>				element_counts;
+};
+
+}
@@ -0,0 +1,210 @@
+// StructuralIndex.h : Vectorized pre-pass over keyfile text that locates token and line boundaries 64 bytes at a time.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#pragma once
+
+#include "Common.h"
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define D2R_STRUCTURAL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define D2R_STRUCTURAL_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace d2r
+{
+
+//Separators are the characters that end a token: space, \t, \n, \v, \f, \r and the comma.  Commas are
+//separators here, so free-format (comma delimited) cards are read the same way as fixed-width cards.
+struct BlockMasks
+{
+	uint64_t newline;
+	uint64_t separator;
+};
+
+inline unsigned CountTrailingZeros(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return static_cast<unsigned>(i);
+#elif defined(_MSC_VER)
+	unsigned long i;
+	if (_BitScanForward(&i, static_cast<uint32_t>(x))) return static_cast<unsigned>(i);
+	_BitScanForward(&i, static_cast<uint32_t>(x >> 32));
+	return static_cast<unsigned>(i) + 32;
+#else
+	return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+inline bool IsSeparator(char c)
+{
+	return c == ' ' || c == ',' || (static_cast<unsigned char>(c) - 9u) <= 4u;
+}
+
+//Classifies the 64 bytes starting at p; bit i of each mask describes p[i]
+inline BlockMasks ClassifyBlock(char const *p)
+{
+	BlockMasks m;
+#if defined(D2R_STRUCTURAL_AVX2)
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i sp = _mm256_set1_epi8(' ');
+	const __m256i comma = _mm256_set1_epi8(',');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i four = _mm256_set1_epi8(4);
+	uint64_t newline = 0, separator = 0;
+	for (int k = 0; k < 2; ++k)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + 32 * k));
+		__m256i ctl = _mm256_sub_epi8(v, tab); //\t..\r map to 0..4
+		__m256i is_ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, four), ctl);
+		__m256i is_sep = _mm256_or_si256(is_ctl,
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, comma)));
+		newline |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)))) << (32 * k);
+		separator |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(is_sep))) << (32 * k);
+	}
+	m.newline = newline;
+	m.separator = separator;
+#elif defined(D2R_STRUCTURAL_SSE2)
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i sp = _mm_set1_epi8(' ');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i four = _mm_set1_epi8(4);
+	uint64_t newline = 0, separator = 0;
+	for (int k = 0; k < 4; ++k)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16 * k));
+		__m128i ctl = _mm_sub_epi8(v, tab); //\t..\r map to 0..4
+		__m128i is_ctl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl);
+		__m128i is_sep = _mm_or_si128(is_ctl,
+			_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, comma)));
+		newline |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) & 0xffff) << (16 * k);
+		separator |= static_cast<uint64_t>(_mm_movemask_epi8(is_sep) & 0xffff) << (16 * k);
+	}
+	m.newline = newline;
+	m.separator = separator;
+#else
+	m.newline = 0;
+	m.separator = 0;
+	for (int i = 0; i < 64; ++i)
+	{
+		m.newline |= static_cast<uint64_t>(p[i] == '\n') << i;
+		m.separator |= static_cast<uint64_t>(IsSeparator(p[i])) << i;
+	}
+#endif
+	return m;
+}
+
+//Offsets of every token start, token end and newline in a buffer of complete lines.  The card parsers
+//walk these offsets instead of looking at the text one character at a time.
+class StructuralIndex
+{
+public:
+	StructuralIndex()
+		: data(nullptr)
+		, length(0)
+		, nTokens(0)
+	{}
+
+	//data must stay readable up to the next multiple of 64 bytes past length; bytes past length are ignored
+	void Build(char const *data_, size_t length_)
+	{
+		data = data_;
+		length = length_;
+		marks.clear();
+		nTokens = 0;
+
+		uint64_t prev_separator = 1; //the start of the buffer behaves like the end of a separator
+		for (size_t block = 0; block < length; block += 64)
+		{
+			BlockMasks m = ClassifyBlock(data + block);
+			uint64_t shifted = (m.separator << 1) | prev_separator;
+			prev_separator = m.separator >> 63;
+
+			uint64_t starts = ~m.separator & shifted;
+			uint64_t ends = m.separator & ~shifted;
+			uint64_t bits = starts | ends | m.newline;
+			if (length - block < 64) bits &= (uint64_t(1) << (length - block)) - 1;
+
+			while (bits)
+			{
+				size_t pos = block + CountTrailingZeros(bits);
+				marks.push_back(static_cast<uint32_t>(pos));
+				nTokens += !IsSeparator(data[pos]);
+				bits &= bits - 1;
+			}
+		}
+		cursor = 0;
+		line_start = 0;
+	}
+
+	size_t GetTokenCount() const
+	{
+		return nTokens;
+	}
+
+	//Moves to the next line; returns false when the buffer is exhausted
+	bool NextLine()
+	{
+		//skip whatever is left of the current line
+		while (cursor < marks.size() && data[marks[cursor]] != '\n') ++cursor;
+		if (cursor >= marks.size()) return false;
+		line_start = marks[cursor] + 1;
+		++cursor;
+		return line_start < length;
+	}
+
+	//The first line starts at offset 0; call this once before the first NextLine
+	void Rewind()
+	{
+		cursor = 0;
+		line_start = 0;
+	}
+
+	char const *LineBegin() const
+	{
+		return data + line_start;
+	}
+
+	//End of the current line, excluding the newline
+	char const *LineEnd() const
+	{
+		size_t k = cursor;
+		while (k < marks.size() && data[marks[k]] != '\n') ++k;
+		return data + (k < marks.size() ? marks[k] : length);
+	}
+
+	//Returns the next token of the current line as [b, e); false at the end of the line
+	bool NextToken(char const *&b, char const *&e)
+	{
+		if (cursor >= marks.size() || data[marks[cursor]] == '\n' || IsSeparator(data[marks[cursor]])) {
+			//a separator mark that is not a newline cannot start a token, so skip it
+			while (cursor < marks.size() && data[marks[cursor]] != '\n' && IsSeparator(data[marks[cursor]])) ++cursor;
+			if (cursor >= marks.size() || data[marks[cursor]] == '\n') return false;
+		}
+		b = data + marks[cursor++];
+		e = data + (cursor < marks.size() ? marks[cursor] : length);
+		if (cursor < marks.size() && data[marks[cursor]] != '\n') ++cursor; //consume the token end, but not a newline
+		return true;
+	}
+
+private:
+	char const *data;
+	size_t length;
+	size_t nTokens;
+	vector<uint32_t> marks;
+	size_t cursor;
+	size_t line_start;
+};
+
+}
@@ -0,0 +1,507 @@
+// LSDynaToRawTests.cpp : Checks of the LSDynaToRawLib library, most of them run against the sample decks in decks/.
+//						  The decks directory may be given as the first argument.  Returns 0 when every check passes.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "Adjacency.h"
+#include "ColumnarFile.h"
+#include "Model.h"
+#include "MeshQuality.h"
+#include "MeshTools.h"
+#include "Sets.h"
+#include "SpatialIndex.h"
+
+namespace fs = boost::filesystem;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace d2r;
+
+namespace
+{
+	int failures = 0;
+
+	void Check(bool ok, char const *what, string const &context, int line)
+	{
+		if (ok) return;
+		failures += 1;
+		cout << "  line " << line << ": " << what << " failed" << (context.empty() ? "" : " for " + context) << endl;
+	}
+
+#define CHECK(condition, context) Check((condition), #condition, (context), __LINE__)
+
+	bool Near(double a, double b)
+	{
+		return std::abs(a - b) <= 1e-12 * std::max(1.0, std::abs(b));
+	}
+
+	//The structural index parser and the legacy lexer must read the same nodes, elements, parts and sets
+	void CheckParsersAgree(fs::path const &deck)
+	{
+		Model indexed, legacy;
+		indexed.SetVerbose(false);
+		legacy.SetVerbose(false);
+		legacy.SetLegacyLexer(true);
+		indexed.Append(deck.string());
+		legacy.Append(deck.string());
+		string name = deck.filename().string();
+
+		FiniteElementObject const &a = indexed.GetObjects(), &b = legacy.GetObjects();
+		CHECK(!a.nodes.nids.empty(), name);
+		CHECK(a.nodes.nids == b.nodes.nids, name);
+		CHECK(a.nodes.x == b.nodes.x, name);
+		CHECK(a.nodes.y == b.nodes.y, name);
+		CHECK(a.nodes.z == b.nodes.z, name);
+		CHECK(a.elements.eids == b.elements.eids, name);
+		CHECK(a.elements.pids == b.elements.pids, name);
+		CHECK(a.elements.n1 == b.elements.n1 && a.elements.n2 == b.elements.n2
+			&& a.elements.n3 == b.elements.n3 && a.elements.n4 == b.elements.n4
+			&& a.elements.n5 == b.elements.n5 && a.elements.n6 == b.elements.n6
+			&& a.elements.n7 == b.elements.n7 && a.elements.n8 == b.elements.n8, name);
+
+		vector<int> pids = indexed.GetPartIDs();
+		CHECK(pids == legacy.GetPartIDs(), name);
+		for (auto it = pids.begin(); it != pids.end(); ++it)
+			CHECK(indexed.GetPartName(*it) == legacy.GetPartName(*it), name + ", part " + std::to_string(*it));
+
+		SetMap const &sa = indexed.GetSets(), &sb = legacy.GetSets();
+		CHECK(sa.size() == sb.size(), name);
+		for (auto it = begin(sa); it != end(sa); ++it)
+		{
+			auto other = sb.find(it->first);
+			bool same = other != sb.end() && other->second.title == it->second.title
+				&& other->second.members.ToVector() == it->second.members.ToVector();
+			CHECK(same, name + ", " + SetKindName(it->second.kind) + " set " + std::to_string(it->second.sid));
+		}
+	}
+
+	//A unit cube, and a tetrahedron whose shortest edge is n1-n3, the edge the hexahedron's edge table does not have
+	void CheckElementQuality()
+	{
+		FiniteElementObject obj;
+		double const xyz[12][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 },
+			{ 0, 0, 0 }, { 3, 0, 0 }, { 0, 1, 0 }, { 0, 0, 2 } };
+		for (int k = 0; k < 12; ++k)
+		{
+			obj.nodes.AddNode(k + 1, xyz[k][0], xyz[k][1], xyz[k][2]);
+			obj.node_index[k + 1] = k;
+		}
+		obj.elements.AddElement(1, 1, Element(1, 2, 3, 4, 5, 6, 7, 8));
+		obj.elements.AddElement(2, 1, Element(9, 10, 11, 12, 12, 12, 12, 12));
+
+		ElementQuality Q = MeasureQuality(obj);
+		CHECK(Near(Q.jacobian[0], 1.0), "cube");
+		CHECK(Near(Q.aspect[0], 1.0), "cube");
+		CHECK(Near(Q.warpage[0], 0.0), "cube");
+
+		//edges 3, 1, 2 from n1 and sqrt(10), sqrt(13), sqrt(5) between n2, n3 and n4
+		CHECK(Near(Q.min_edge[1], 1.0), "tetrahedron");
+		CHECK(Near(Q.max_edge[1], std::sqrt(13.0)), "tetrahedron");
+		CHECK(Near(Q.aspect[1], std::sqrt(13.0)), "tetrahedron");
+		CHECK(std::isnan(Q.warpage[1]), "tetrahedron");
+	}
+
+	//Shapes written with repeated nodes whose worst corner is one that the hexahedron's corners cannot see:
+	//n4 of a tetrahedron, the apex of a tall pyramid and the ridge of a tall wedge
+	void CheckDegenerateJacobians()
+	{
+		FiniteElementObject obj;
+		double const xyz[15][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 1 },
+			{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0.5, 0.5, 10 },
+			{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0.5, 0, 10 }, { 0.5, 1, 10 } };
+		for (int k = 0; k < 15; ++k)
+		{
+			obj.nodes.AddNode(k + 1, xyz[k][0], xyz[k][1], xyz[k][2]);
+			obj.node_index[k + 1] = k;
+		}
+		obj.elements.AddElement(1, 1, Element(1, 2, 3, 4, 4, 4, 4, 4));
+		obj.elements.AddElement(2, 1, Element(5, 6, 7, 8, 9, 9, 9, 9));
+		obj.elements.AddElement(3, 1, Element(10, 11, 12, 13, 14, 14, 15, 15));
+
+		ElementQuality Q = MeasureQuality(obj);
+		//at n4 the edges to n2, n1 and n3 have squared lengths 2, 3 and 2 and span a volume of 1; at n2 it is 1/2
+		CHECK(Near(Q.jacobian[0], 1 / std::sqrt(12.0)), "tetrahedron");
+		//the apex sees three base corners along edges of squared length 100.5; the base corners are near 1
+		CHECK(Near(Q.jacobian[1], 10 / std::pow(100.5, 1.5)), "pyramid");
+		//a ridge node sees both ends of the other ridge edge, 100.25 away squared, and the ridge of length 1
+		CHECK(Near(Q.jacobian[2], 10 / 100.25), "wedge");
+	}
+
+	//IdSet against std::set, across the switch of a group from a sorted array to a bitmap at 4096 members
+	void CheckIdSet()
+	{
+		IdSet ids;
+		std::set<int> expected;
+		auto same = [&]() {
+			return ids.Size() == expected.size() && ids.ToVector() == vector<int>(expected.begin(), expected.end());
+		};
+
+		//4096 members of the group of IDs 65536 .. 131071 fill its array, out of order and with repeats
+		std::mt19937 random(39);
+		while (expected.size() < 4096)
+		{
+			int id = 65536 + static_cast<int>(random() % 65536);
+			ids.Add(id);
+			expected.insert(id);
+		}
+		CHECK(same(), "IdSet, 4096 members");
+		int absent = 65536;
+		while (expected.count(absent)) ++absent;
+		ids.Add(absent);
+		expected.insert(absent);
+		CHECK(same(), "IdSet, 4097 members");
+		ids.Add(absent);
+		CHECK(same(), "IdSet, repeated member");
+
+		//a range across two group boundaries, part of it in the dense group; zero and negative IDs are blank fields
+		ids.AddRange(130000, 200000);
+		for (int id = 130000; id <= 200000; ++id) expected.insert(id);
+		ids.Add(0);
+		ids.Add(-5);
+		ids.AddRange(-10, 3);
+		for (int id = 1; id <= 3; ++id) expected.insert(id);
+		CHECK(same(), "IdSet, ranges");
+
+		bool contains = true;
+		for (int id = -2; id < 210000; ++id) contains = contains && ids.Contains(id) == (expected.count(id) > 0);
+		CHECK(contains, "IdSet, Contains");
+
+		IdSet copy;
+		copy.AddRange(5, 8);
+		copy.Add(ids);
+		for (int id = 5; id <= 8; ++id) expected.insert(id);
+		CHECK(copy.ToVector() == vector<int>(expected.begin(), expected.end()) && copy.Size() == expected.size(), "IdSet, union");
+	}
+
+	//The sets of blocks.k: block A is elements 1-27 on nodes 1-64 and block B elements 28-54 on nodes 65-128.
+	//Several --set options select the elements that are in all of them, and a node set only selects an
+	//element whose nodes are all in it.
+	void CheckSets(fs::path const &deck)
+	{
+		Model model;
+		model.SetVerbose(false);
+		model.Append(deck.string());
+		SetMap const &sets = model.GetSets();
+		auto members = [&](SetKind kind, int sid) {
+			auto it = sets.find(std::make_pair(static_cast<int>(kind), sid));
+			return it == sets.end() ? vector<int>() : it->second.members.ToVector();
+		};
+		vector<int> range, core;
+		for (int id = 1; id <= 64; ++id) range.push_back(id);
+		for (int id = 10; id <= 18; ++id) core.push_back(id);
+		for (int id = 40; id <= 45; ++id) core.push_back(id);
+		CHECK(members(NODE_SET, 5) == range, "*SET_NODE_GENERATE");
+		CHECK(members(SOLID_SET, 3) == core, "*SET_SOLID_GENERATE_TITLE");
+		CHECK(members(PART_SET, 7) == vector<int>({ 2 }), "*SET_PART_LIST");
+
+		//the element IDs of the elements that pass every set in specs
+		Elements const &E = model.GetObjects().elements;
+		auto select = [&](std::initializer_list<char const *> specs) {
+			SetFilter filter;
+			for (char const *spec : specs) filter.Select(sets, spec);
+			vector<int> eids;
+			vector<size_t> kept = filter.Filter(E);
+			for (size_t i : kept) eids.push_back(E.eids[i]);
+			return eids;
+		};
+		vector<int> block_a, core_a(core.begin(), core.begin() + 9), core_b(core.begin() + 9, core.end());
+		for (int id = 1; id <= 27; ++id) block_a.push_back(id);
+		CHECK(select({ "node:5" }) == block_a, "--set node:5");
+		CHECK(select({ "Bottom nodes" }).empty(), "--set \"Bottom nodes\"");
+		CHECK(select({ "core, first layer" }) == core, "--set \"core, first layer\"");
+		CHECK(select({ "node:5", "solid:3" }) == core_a, "--set node:5 --set solid:3");
+		CHECK(select({ "solid:3", "part:7" }) == core_b, "--set solid:3 --set part:7");
+		CHECK(select({ "node:5", "part:7" }).empty(), "--set node:5 --set part:7");
+	}
+
+	//The adjacency of the renumbered hexahedra of a deck against a comparison of every pair of elements
+	void CheckAdjacency(fs::path const &deck)
+	{
+		Model model;
+		model.SetVerbose(false);
+		model.Append(deck.string());
+		FiniteElementObject obj = Renumber_Nodes(model.GetObjects());
+		Elements const &E = obj.elements;
+		size_t nElements = E.eids.size();
+		vector<vector<int>> nodes(nElements);
+		for (size_t i = 0; i < nElements; ++i)
+			nodes[i] = { E.n1[i], E.n2[i], E.n3[i], E.n4[i], E.n5[i], E.n6[i], E.n7[i], E.n8[i] };
+
+		CsrAdjacency node_elements = NodeElementAdjacency(obj);
+		bool same = node_elements.Rows() == obj.nodes.nids.size();
+		for (size_t j = 0; same && j < node_elements.Rows(); ++j)
+		{
+			vector<int> expected;
+			for (size_t i = 0; i < nElements; ++i)
+				if (std::count(nodes[i].begin(), nodes[i].end(), static_cast<int>(j) + 1)) expected.push_back(static_cast<int>(i));
+			same = vector<int>(node_elements.RowBegin(j), node_elements.RowEnd(j)) == expected;
+		}
+		CHECK(same, deck.filename().string() + ", NodeElementAdjacency");
+
+		//two hexahedra are neighbors when one of the six faces of each has the same four nodes
+		int const faces[6][4] = { {0,1,2,3}, {4,5,6,7}, {0,1,5,4}, {1,2,6,5}, {2,3,7,6}, {3,0,4,7} };
+		vector<std::set<vector<int>>> element_faces(nElements);
+		for (size_t i = 0; i < nElements; ++i)
+			for (int f = 0; f < 6; ++f)
+			{
+				vector<int> face = { nodes[i][faces[f][0]], nodes[i][faces[f][1]], nodes[i][faces[f][2]], nodes[i][faces[f][3]] };
+				std::sort(face.begin(), face.end());
+				element_faces[i].insert(face);
+			}
+		CsrAdjacency neighbors = FaceNeighbors(obj, node_elements);
+		same = neighbors.Rows() == nElements;
+		size_t pairs = 0;
+		for (size_t i = 0; same && i < nElements; ++i)
+		{
+			vector<int> expected;
+			for (size_t k = 0; k < nElements; ++k)
+			{
+				if (k == i) continue;
+				bool shared = false;
+				for (auto face = element_faces[i].begin(); face != element_faces[i].end() && !shared; ++face)
+					shared = element_faces[k].count(*face) > 0;
+				if (shared) expected.push_back(static_cast<int>(k));
+			}
+			pairs += expected.size();
+			same = vector<int>(neighbors.RowBegin(i), neighbors.RowEnd(i)) == expected;
+		}
+		CHECK(same, deck.filename().string() + ", FaceNeighbors");
+		//each 3x3x3 block has 3 * 2 * 9 interior faces, and each is counted from both of its elements
+		CHECK(pairs == 2 * 2 * 54, deck.filename().string() + ", FaceNeighbors");
+	}
+
+	//An n x n x n block of unit hexahedra, with node and element IDs numbered consecutively from 1
+	FiniteElementObject HexGrid(int n)
+	{
+		FiniteElementObject obj;
+		int m = n + 1;
+		for (int k = 0; k < m; ++k)
+			for (int j = 0; j < m; ++j)
+				for (int i = 0; i < m; ++i)
+				{
+					obj.node_index[1 + i + m * (j + m * k)] = static_cast<int>(obj.nodes.nids.size());
+					obj.nodes.AddNode(1 + i + m * (j + m * k), i, j, k);
+				}
+
+		Elements &E = obj.elements;
+		for (int k = 0; k < n; ++k)
+			for (int j = 0; j < n; ++j)
+				for (int i = 0; i < n; ++i)
+				{
+					int a = 1 + i + m * (j + m * k);
+					obj.element_index[static_cast<int>(E.eids.size()) + 1] = static_cast<int>(E.eids.size());
+					E.eids.push_back(static_cast<int>(E.eids.size()) + 1);
+					E.pids.push_back(1);
+					E.n1.push_back(a);
+					E.n2.push_back(a + 1);
+					E.n3.push_back(a + 1 + m);
+					E.n4.push_back(a + m);
+					E.n5.push_back(a + m * m);
+					E.n6.push_back(a + 1 + m * m);
+					E.n7.push_back(a + 1 + m + m * m);
+					E.n8.push_back(a + m + m * m);
+				}
+		return obj;
+	}
+
+	//Columns of more than one 65536 value chunk must come back exactly as written: IDs that jump down as well as
+	//up, and doubles bit for bit, including signed zeros, infinities and NaN
+	void CheckColumnarRoundTrip()
+	{
+		std::mt19937_64 random(2020);
+		vector<int64_t> ids(150001);
+		int64_t id = 0;
+		for (size_t i = 0; i < ids.size(); ++i)
+		{
+			//mostly small steps in either direction, with an occasional jump of up to 2^40
+			int64_t step = static_cast<int64_t>(random() % 2001) - 1000;
+			if (i % 997 == 0) step = static_cast<int64_t>(random() % (int64_t(1) << 41)) - (int64_t(1) << 40);
+			ids[i] = id += step;
+		}
+		vector<int> descending(70000);
+		for (size_t i = 0; i < descending.size(); ++i) descending[i] = 1000000 - 37 * static_cast<int>(i);
+		vector<double> values(140000);
+		std::normal_distribution<double> normal(0.0, 1e3);
+		for (size_t i = 0; i < values.size(); ++i) values[i] = normal(random);
+		double const special[] = { 0.0, -0.0, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+			std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::max() };
+		for (size_t k = 0; k < sizeof(special) / sizeof(special[0]); ++k) values[65535 + k] = special[k];
+
+		//a part whose element IDs count down, written by OutputColumnar as the converter writes it
+		FiniteElementObject grid = HexGrid(42);
+		for (size_t i = 0; i < grid.elements.eids.size(); ++i) grid.elements.eids[i] = static_cast<int>(grid.elements.eids.size() - i);
+
+		fs::path file = fs::temp_directory_path() / fs::unique_path("d2r-%%%%-%%%%-%%%%.d2rc");
+		fs::path part_file = fs::temp_directory_path() / fs::unique_path("d2r-%%%%-%%%%-%%%%.d2rc");
+		{
+			ColumnarWriter w(file);
+			w.AddIds("ids", ids);
+			w.AddIds("descending", descending);
+			w.AddValues("values", values);
+		}
+		OutputColumnar(part_file.string(), grid, true);
+
+		//the readers are closed before the files are removed
+		{
+			ColumnarReader r(file);
+			CHECK(r.GetColumnNames() == vector<string>({ "ids", "descending", "values" }), "columnar");
+			CHECK(r.ReadIds("ids") == ids, "columnar");
+			vector<int64_t> read_descending = r.ReadIds("descending");
+			CHECK(vector<int64_t>(descending.begin(), descending.end()) == read_descending, "columnar");
+			vector<double> read_values = r.ReadValues("values");
+			CHECK(read_values.size() == values.size()
+				&& std::memcmp(read_values.data(), values.data(), values.size() * sizeof(double)) == 0, "columnar");
+
+			bool threw = false;
+			try { r.ReadIds("values"); }
+			catch (std::exception const &) { threw = true; }
+			CHECK(threw, "columnar, ids read from a value column");
+		}
+		{
+			ColumnarReader part(part_file);
+			Nodes nodes = part.ReadNodes();
+			Elements elements = part.ReadElements();
+			CHECK(nodes.nids == grid.nodes.nids && nodes.x == grid.nodes.x && nodes.y == grid.nodes.y && nodes.z == grid.nodes.z, "columnar part");
+			CHECK(elements.eids == grid.elements.eids && elements.pids == grid.elements.pids
+				&& elements.n1 == grid.elements.n1 && elements.n2 == grid.elements.n2
+				&& elements.n3 == grid.elements.n3 && elements.n4 == grid.elements.n4
+				&& elements.n5 == grid.elements.n5 && elements.n6 == grid.elements.n6
+				&& elements.n7 == grid.elements.n7 && elements.n8 == grid.elements.n8, "columnar part");
+		}
+
+		boost::system::error_code ec;
+		fs::remove(file, ec);
+		fs::remove(part_file, ec);
+	}
+
+	//The BVH must select exactly the elements that a scan of every element selects: those with a node in the region
+	void CheckRegionQuery(FiniteElementObject const &objects, string const &name, bool expect_hits)
+	{
+		double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+		Nodes const &N = objects.nodes;
+		for (size_t i = 0; i < N.nids.size(); ++i)
+		{
+			double xyz[3] = { N.x[i], N.y[i], N.z[i] };
+			for (int d = 0; d < 3; ++d) {
+				lo[d] = std::min(lo[d], xyz[d]);
+				hi[d] = std::max(hi[d], xyz[d]);
+			}
+		}
+		double c[3], size = 0;
+		for (int d = 0; d < 3; ++d) {
+			c[d] = 0.5 * (lo[d] + hi[d]);
+			size = std::max(size, hi[d] - lo[d]);
+		}
+		auto list = [](std::initializer_list<double> values) {
+			string text;
+			for (double v : values) text += (text.empty() ? "" : ",") + std::to_string(v);
+			return text;
+		};
+		double along = (c[0] + 2 * c[1] - c[2]) / std::sqrt(6.0); //the center's distance along the slab normal
+		string specs[] = {
+			"box:" + list({ lo[0] + 0.2 * size, lo[1] + 0.1 * size, lo[2] - 1, c[0] + 0.15 * size, c[1], c[2] + 0.05 * size }),
+			"sphere:" + list({ c[0] + 0.1 * size, c[1] - 0.1 * size, c[2], 0.3 * size }),
+			"slab:" + list({ 1, 2, -1, along - 0.1 * size, along + 0.15 * size })
+		};
+
+		ElementBVH bvh(objects);
+		vector<int> const *columns[8] = { &objects.elements.n1, &objects.elements.n2, &objects.elements.n3, &objects.elements.n4,
+			&objects.elements.n5, &objects.elements.n6, &objects.elements.n7, &objects.elements.n8 };
+		for (string const &spec : specs)
+		{
+			Region region = Region::Parse(spec);
+			vector<size_t> expected;
+			for (size_t i = 0; i < objects.elements.eids.size(); ++i)
+				for (int k = 0; k < 8; ++k)
+				{
+					auto node = objects.node_index.find((*columns[k])[i]);
+					if (node != objects.node_index.end() && region.Contains(N.x[node->second], N.y[node->second], N.z[node->second])) {
+						expected.push_back(i);
+						break;
+					}
+				}
+			CHECK(bvh.Query(region) == expected, name + ", " + spec);
+			if (expect_hits) CHECK(!expected.empty() && expected.size() < objects.elements.eids.size(), name + ", " + spec);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	fs::path decks = argc > 1 ? fs::path(argv[1]) : fs::path(__FILE__).parent_path() / "decks";
+	vector<fs::path> files;
+	for (fs::directory_iterator it(decks); it != fs::directory_iterator(); ++it)
+		if (it->path().extension() == ".k") files.push_back(it->path());
+	std::sort(files.begin(), files.end());
+	if (files.empty()) {
+		cout << "No sample decks found in " << decks.string() << endl;
+		return 1;
+	}
+
+	cout << "Parsers agree" << endl;
+	for (auto it = files.begin(); it != files.end(); ++it)
+	{
+		try {
+			CheckParsersAgree(*it);
+		}
+		catch (std::exception const &e) {
+			Check(false, e.what(), it->filename().string(), __LINE__);
+		}
+	}
+
+	cout << "Element quality" << endl;
+	CheckElementQuality();
+	CheckDegenerateJacobians();
+
+	cout << "Sets" << endl;
+	CheckIdSet();
+	try {
+		CheckSets(decks / "blocks.k");
+	}
+	catch (std::exception const &e) {
+		Check(false, e.what(), "blocks.k", __LINE__);
+	}
+
+	cout << "Adjacency" << endl;
+	try {
+		CheckAdjacency(decks / "blocks.k");
+	}
+	catch (std::exception const &e) {
+		Check(false, e.what(), "blocks.k", __LINE__);
+	}
+
+	cout << "Region queries" << endl;
+	for (auto it = files.begin(); it != files.end(); ++it)
+	{
+		try {
+			Model model;
+			model.SetVerbose(false);
+			model.Append(it->string());
+			CheckRegionQuery(model.GetObjects(), it->filename().string(), false);
+		}
+		catch (std::exception const &e) {
+			Check(false, e.what(), it->filename().string(), __LINE__);
+		}
+	}
+	//large enough that the two halves of the upper levels of the tree are built on separate threads
+	CheckRegionQuery(HexGrid(30), "30x30x30 grid", true);
+
+	cout << "Columnar files" << endl;
+	CheckColumnarRoundTrip();
+
+	if (failures) cout << failures << " checks failed" << endl;
+	else cout << "All checks passed" << endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+// LSDynaToRawModule.cpp : Python bindings for the LSDynaToRaw library.  Parts are handed to Python as
+//						   NumPy arrays that refer directly to the arrays of the isolated part.
+// Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+//
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <mutex>
+#include "Model.h"
+#include "MeshTools.h"
+
+namespace py = pybind11;
+using namespace d2r;
+
+namespace
+{
+	//An isolated part, shared by every array that refers into it
+	struct Part
+	{
+		int pid;
+		string name;
+		FiniteElementObject obj;
+	};
+
+	typedef std::shared_ptr<Part> PartPtr;
+
+	//The Model exposed to Python.  Its methods run without the GIL, so two Python threads may call into the
+	//same Model at once; the mutex keeps them from reading it while another appends to or merges it.
+	struct SharedModel
+	{
+		Model model;
+		std::mutex mutex;
+	};
+
+	//Runs f on the model with the GIL released and the model locked.  The GIL is released first, so a thread
+	//waiting for the lock does not keep the thread that holds it from returning to Python.
+	template <typename F>
+	auto Locked(SharedModel &shared, F f) -> decltype(f(shared.model))
+	{
+		py::gil_scoped_release release;
+		std::lock_guard<std::mutex> lock(shared.mutex);
+		return f(shared.model);
+	}
+
+	//Wraps v as a read-only 1-D array without copying.  The capsule holds a reference to the part,
+	//so the array stays valid after the Part object and the Model are gone.
+	template <typename T>
+	py::array_t<T> View(PartPtr const &part, vector<T> const &v)
+	{
+		py::capsule base(new PartPtr(part), [](void *p) { delete static_cast<PartPtr*>(p); });
+		py::array_t<T> a(v.size(), v.data(), base);
+		a.attr("setflags")(py::arg("write") = false);
+		return a;
+	}
+
+	PartPtr ExtractPart(SharedModel &shared, int pid, bool renumber)
+	{
+		auto part = std::make_shared<Part>();
+		part->pid = pid;
+		Locked(shared, [&](Model &model) {
+			part->name = model.GetPartName(pid);
+			part->obj = model.ExtractPart(pid, renumber);
+		});
+		return part;
+	}
+}
+
+PYBIND11_MODULE(lsdynatoraw, m)
+{
+	m.doc() = "Reads the nodes, elements and parts of LS-Dyna keyfiles into NumPy arrays";
+
+	py::class_<Part, PartPtr>(m, "Part")
+		.def_readonly("pid", &Part::pid)
+		.def_readonly("name", &Part::name)
+		.def_property_readonly("nids", [](PartPtr const &p) { return View(p, p->obj.nodes.nids); })
+		.def_property_readonly("x", [](PartPtr const &p) { return View(p, p->obj.nodes.x); })
+		.def_property_readonly("y", [](PartPtr const &p) { return View(p, p->obj.nodes.y); })
+		.def_property_readonly("z", [](PartPtr const &p) { return View(p, p->obj.nodes.z); })
+		.def_property_readonly("eids", [](PartPtr const &p) { return View(p, p->obj.elements.eids); })
+		.def_property_readonly("pids", [](PartPtr const &p) { return View(p, p->obj.elements.pids); })
+		.def_property_readonly("n1", [](PartPtr const &p) { return View(p, p->obj.elements.n1); })
+		.def_property_readonly("n2", [](PartPtr const &p) { return View(p, p->obj.elements.n2); })
+		.def_property_readonly("n3", [](PartPtr const &p) { return View(p, p->obj.elements.n3); })
+		.def_property_readonly("n4", [](PartPtr const &p) { return View(p, p->obj.elements.n4); })
+		.def_property_readonly("n5", [](PartPtr const &p) { return View(p, p->obj.elements.n5); })
+		.def_property_readonly("n6", [](PartPtr const &p) { return View(p, p->obj.elements.n6); })
+		.def_property_readonly("n7", [](PartPtr const &p) { return View(p, p->obj.elements.n7); })
+		.def_property_readonly("n8", [](PartPtr const &p) { return View(p, p->obj.elements.n8); })
+		.def("write", [](PartPtr const &p, string const &base_name) {
+				py::gil_scoped_release release;
+				OutputToFiles(base_name, p->obj, true);
+			}, py::arg("base_name"),
+			"Writes <base_name>-nodes.txt and <base_name>-elements.txt, replacing existing files")
+		.def("__repr__", [](PartPtr const &p) {
+				return "<Part " + boost::lexical_cast<string>(p->pid) + " '" + p->name + "': "
+					+ boost::lexical_cast<string>(p->obj.nodes.nids.size()) + " nodes, "
+					+ boost::lexical_cast<string>(p->obj.elements.eids.size()) + " elements>";
+			});
+
+	py::class_<SharedModel>(m, "Model")
+		.def(py::init([](bool verbose) {
+				auto shared = std::make_unique<SharedModel>();
+				shared->model.SetVerbose(verbose);
+				return shared;
+			}), py::arg("verbose") = false)
+		.def("append", [](SharedModel &shared, string const &file_name) {
+				Locked(shared, [&](Model &model) { model.Append(file_name); });
+			}, py::arg("file_name"),
+			"Parses a keyfile and adds its nodes, elements and parts to the model")
+		.def("append", [](SharedModel &shared, string const &file_name, string const &cache_file) {
+				Locked(shared, [&](Model &model) { model.Append(file_name, cache_file); });
+			}, py::arg("file_name"), py::arg("cache_file"),
+			"As append, but also saves what was read to cache_file so that a later restore can stand in for parsing the keyfile again")
+		.def("restore", [](SharedModel &shared, string const &cache_file) {
+				Locked(shared, [&](Model &model) { model.Restore(cache_file); });
+			}, py::arg("cache_file"),
+			"Adds the nodes, elements and parts saved in a cache_file by append")
+		.def("merge_coincident_nodes", [](SharedModel &shared, double tolerance) {
+				return Locked(shared, [&](Model &model) { return model.MergeCoincidentNodes(tolerance); });
+			}, py::arg("tolerance"),
+			"Merges nodes closer together than tolerance; returns the number of nodes removed")
+		.def("part_ids", [](SharedModel &shared) {
+				return Locked(shared, [](Model &model) { return model.GetPartIDs(); });
+			})
+		.def("part_name", [](SharedModel &shared, int pid) {
+				return Locked(shared, [&](Model &model) { return model.GetPartName(pid); });
+			}, py::arg("pid"))
+		.def("part", &ExtractPart, py::arg("pid"), py::arg("renumber") = true,
+			"Isolates a part, by default renumbering its nodes and elements from 1 as in the exported files")
+		.def("parts", [](SharedModel &shared, bool renumber) {
+				vector<PartPtr> parts;
+				vector<int> pids = Locked(shared, [](Model &model) { return model.GetPartIDs(); });
+				for (auto it = pids.begin(); it != pids.end(); ++it) parts.push_back(ExtractPart(shared, *it, renumber));
+				return parts;
+			}, py::arg("renumber") = true);
+}
@@ -0,0 +1,54 @@
+# setup.py : Builds the lsdynatoraw Python extension from the LSDynaToRawLib sources.
+#            Requires pybind11 and Boost; set BOOST_ROOT to the Boost installation on Windows.
+#            python setup.py build_ext --inplace && python test_lsdynatoraw.py builds and checks it in place.
+# Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+#
+
+import os
+import sys
+from glob import glob
+from setuptools import setup
+from pybind11.setup_helpers import Pybind11Extension, build_ext
+
+lib = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "LSDynaToRawLib")
+
+include_dirs = [lib]
+library_dirs = []
+libraries = []
+define_macros = []
+extra_compile_args = []
+extra_link_args = []
+if sys.platform == "win32":
+    #Boost selects its own libraries through auto-linking
+    boost = os.environ.get("BOOST_ROOT", "")
+    if boost:
+        include_dirs.append(boost)
+        library_dirs.append(os.path.join(boost, "stage", "lib"))
+else:
+    #the sources are written for MSVC: KeyFile.h and KeyFileLexer.h redeclare string inside their classes,
+    #and strcmpi is spelled strcasecmp and declared in strings.h
+    extra_compile_args += ["-fpermissive", "-include", "strings.h"]
+    extra_link_args.append("-pthread")
+    define_macros.append(("strcmpi", "strcasecmp"))
+    libraries += ["boost_filesystem", "boost_iostreams", "boost_system"]
+
+ext = Pybind11Extension(
+    "lsdynatoraw",
+    ["LSDynaToRawModule.cpp"] + sorted(glob(os.path.join(lib, "*.cpp"))),
+    include_dirs=include_dirs,
+    library_dirs=library_dirs,
+    libraries=libraries,
+    define_macros=define_macros,
+    extra_compile_args=extra_compile_args,
+    extra_link_args=extra_link_args,
+    cxx_std=14,
+)
+
+setup(
+    name="lsdynatoraw",
+    version="1.0",
+    description="Reads the nodes, elements and parts of LS-Dyna keyfiles into NumPy arrays",
+    ext_modules=[ext],
+    cmdclass={"build_ext": build_ext},
+    zip_safe=False,
+)
@@ -0,0 +1,32 @@
+# test_lsdynatoraw.py : Smoke test of the lsdynatoraw extension against a sample deck of the LSDynaToRawTests project.
+#                       Build the extension first with python setup.py build_ext --inplace.
+# Copyright Hunter Gilbert 2020 <hunter DOT gilbert AT outlook.com>
+#
+
+import os
+import unittest
+import lsdynatoraw
+
+deck = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "LSDynaToRawTests", "decks", "blocks.k")
+
+
+class ModelTest(unittest.TestCase):
+    def test_part(self):
+        model = lsdynatoraw.Model()
+        model.append(deck)
+        self.assertEqual(model.part_ids(), [1, 2])
+        self.assertEqual(model.part_name(1), "Block A")
+
+        #a 3x3x3 block of unit hexahedra, renumbered from 1
+        part = model.part(1)
+        self.assertEqual(part.pid, 1)
+        self.assertEqual(len(part.nids), 64)
+        self.assertEqual(len(part.eids), 27)
+        self.assertEqual(list(part.nids), [float(k) for k in range(1, 65)])
+        self.assertEqual((part.x.min(), part.x.max()), (0.0, 3.0))
+        self.assertTrue((part.pids == 1).all())
+        self.assertFalse(part.x.flags.writeable)
+
+
+if __name__ == "__main__":
+    unittest.main()